@@ -12,7 +12,7 @@ void PassbyValueWhenApplicable();
 void ErrorHandlering();
 void Lambda();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( AutoTypeDeduction );
 	Entry( CopyEpsilon );
@@ -22,4 +22,6 @@ int main()
 	Entry( PassbyValueWhenApplicable );
 	Entry( ErrorHandlering );
 	Entry( Lambda );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
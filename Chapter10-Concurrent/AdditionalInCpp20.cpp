@@ -13,6 +13,9 @@
 #include <cassert>
 #include <complex>
 
+#include "LatencyHistogram.h"
+#include "ProfiledMutex.h"
+
 // The stack memory is unlikely to be paged out by the operating system,
 // so it is usually enough to run some code that will generate page faults
 // and thereby map the virtual stack memory to physical memory.
@@ -89,9 +92,10 @@ class BoundedBuffer
 	std::array<T, N> buf_;
 	std::size_t read_pos_{};
 	std::size_t write_pos_{};
-	std::mutex m_;
+	ProfiledMutex m_{ "BoundedBuffer::m_" };
 	std::counting_semaphore<N> n_empty_slots_{ N };
 	std::counting_semaphore<N> n_full_slots_{ 0 };
+	ConcurrentLatencyHistogram pop_latency_; // Time spent waiting for an item, tail latency matters here
 
 	void do_push( auto&& item )
 	{
@@ -123,6 +127,8 @@ public:
 	}
 	auto pop()
 	{
+		auto latency = ScopedLatency{ pop_latency_ };
+
 		// Take one of the full slots (might block)
 		n_full_slots_.acquire();
 
@@ -143,6 +149,10 @@ public:
 		n_empty_slots_.release();
 		return std::move( *item );
 	}
+	auto pop_latency() const -> const ConcurrentLatencyHistogram&
+	{
+		return pop_latency_;
+	}
 };
 
 //-------------------------------------------------------------------------
@@ -319,6 +329,11 @@ void AdditionalInCpp20()
 		auto consumer0 = std::jthread{ consumer, std::ref( buf ) };
 		auto consumer1 = std::jthread{ consumer, std::ref( buf ) };
 		auto consumer2 = std::jthread{ consumer, std::ref( buf ) };
+
+		consumer0.join();
+		consumer1.join();
+		consumer2.join();
+		buf.pop_latency().print( std::cout, "BoundedBuffer::pop" );
 	}
 
 	//-------------------------------------------------------------------------
@@ -3,8 +3,10 @@
 #include <iostream>
 #include <cassert>
 
+#include "ProfiledMutex.h"
+
 auto counter = 0; // Warning! Global mutable variable
-auto counter_mutex = std::mutex{}; // this is also a global mutable variable, but it is safe to use it in different threads.
+auto counter_mutex = ProfiledMutex{ "counter_mutex" }; // this is also a global mutable variable, but it is safe to use it in different threads.
 
 void increment_counter( int n )
 {
@@ -50,6 +52,7 @@ void CriticalSection()
     }
 
     std::cout << counter << '\n';
+    counter_mutex.stats().print( std::cout );
     // If we don't have a data race, this assert should hold:
     assert( counter == ( n * 2 ) );
 
@@ -46,7 +46,7 @@ void AdditionalInCpp20();
 void MemoryModel();
 void CompilerOptimization();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( Thread );
 	Entry( CriticalSection );
@@ -55,4 +55,6 @@ int main()
 	Entry( AdditionalInCpp20 );
 	Entry( MemoryModel );
 	Entry( CompilerOptimization );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
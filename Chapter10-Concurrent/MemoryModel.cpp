@@ -1,6 +1,12 @@
 ﻿#include <iostream>
 #include <array>
 #include <optional>
+#include <atomic>
+#include <thread>
+
+// push()/pop() take a few nanoseconds, so accumulate cycles per call site instead of printing microseconds
+#define USE_TSC_TIMER 1
+#include "ScopeTimer.h"
 
 // The memory model is closely related to concurrency since
 // it defines how the reads and writes to the memory should be visible among threads.
@@ -186,6 +192,7 @@ class LockFreeQueue
 
 	bool do_push( auto&& t ) // Helper function
 	{
+		MEASURE_FUNCTION();
 		if ( size_.load() == N )
 		{
 			return false;
@@ -209,6 +216,7 @@ public:
 	// Reader thread
 	auto pop() -> std::optional<T>
 	{
+		MEASURE_FUNCTION();
 		auto val = std::optional<T>{};
 		if ( size_.load() > 0 )
 		{
@@ -399,4 +407,34 @@ void MemoryModel()
 	// So, you see the key to decide whether a atomic can use a relexed memory order,
 	// it's to check whether using this atomic have _SIDE EFFECT_ to others.
 	// (i.e. whether the usage of atomic has publish some data or do some operations depends on others)
+
+	//-------------------------------------------------------------------------
+
+	{
+		// One writer and one reader thread, the per call cost of push() and pop() is printed at exit.
+		constexpr auto n = 1'000'000;
+		auto queue = LockFreeQueue<int, 1024>{};
+
+		auto writer = std::jthread{ [ & ]
+		{
+			for ( auto i = 0; i < n; )
+			{
+				if ( queue.push( i ) )
+				{
+					++i;
+				}
+			}
+		} };
+
+		auto sum = 0ll;
+		for ( auto received = 0; received < n; )
+		{
+			if ( auto v = queue.pop() )
+			{
+				sum += *v;
+				++received;
+			}
+		}
+		std::cout << "LockFreeQueue sum: " << sum << '\n';
+	}
 }
\ No newline at end of file
@@ -3,10 +3,12 @@
 #include <mutex>
 #include <iostream>
 
-auto cv = std::condition_variable{};
+#include "ProfiledMutex.h"
+
+auto cv = std::condition_variable_any{}; // _any, to wait on a ProfiledMutex
 
 auto q = std::queue<int>{};  // shared queue (shared memory)
-auto mtx = std::mutex{};     // Protects the shared queue
+auto mtx = ProfiledMutex{ "ProducerAndConsumer mtx" }; // Protects the shared queue
 constexpr int sentinel = -1; // Value to signal that we are done
 
 void print_ints()
@@ -15,7 +17,7 @@ void print_ints()
     while ( i != sentinel )
     {
         {
-            auto lock = std::unique_lock<std::mutex>{ mtx };
+            auto lock = std::unique_lock<ProfiledMutex>{ mtx };
             while ( q.empty() )
             {
                 cv.wait( lock ); // The lock is released while waiting, thread goes to sleep, 
@@ -6,11 +6,18 @@
 #include <cassert>
 #include <ranges>
 #include <fstream>
+#include <filesystem>
+#include <span>
+
+#include "CoroutineFramePool.h"
+#include "ScratchArena.h"
+#include "BlockFile.h"
+#include "Benchmark.h"
 
 template <typename T>
 class MyGenerator
 {
-    struct Promise
+    struct Promise : PoolAllocatedFrame // Frames are recycled, or come from the caller's allocator
     { 
         T value_;
         auto get_return_object() -> MyGenerator
@@ -145,11 +152,12 @@ auto lin_value( T start, T stop, size_t index, size_t n )
     return v;
 }
 
-// eager linear range
-template <typename T>
-auto lin_space_eager( T start, T stop, size_t n )
+// eager linear range, pass a ScratchAllocator when the values are only needed temporarily
+template <typename T, typename Alloc = std::allocator<T>>
+auto lin_space_eager( T start, T stop, size_t n, const Alloc& alloc = Alloc{} )
 {
-    auto v = std::vector<T>{};
+    auto v = std::vector<T, Alloc>( alloc );
+    v.reserve( n );
     for ( auto i = 0u; i < n; ++i )
         v.push_back( lin_value( start, stop, i, n ) );
     return v;
@@ -238,6 +246,16 @@ auto lin_space_coroutine( T start, T stop, std::size_t n ) -> MyGenerator<T>
     }
 }
 
+// Ditto, with the coroutine frame allocated by alloc
+template <typename T, typename Alloc>
+auto lin_space_coroutine( std::allocator_arg_t, const Alloc&, T start, T stop, std::size_t n ) -> MyGenerator<T>
+{
+    for ( auto i = 0u; i < n; ++i )
+    {
+        co_yield lin_value( start, stop, i, n );
+    }
+}
+
 //-------------------------------------------------------------------------
 
 // turn inverted index into gap encoding( delta encoding )
@@ -335,20 +353,82 @@ auto decompress( Range& bytes ) -> MyGenerator<int>
 }
 
 template <typename Range>
-void write( const std::string& path, Range& bytes )
+void write( const std::string& path, Range& bytes, IoMode mode = IoMode::Buffered )
+{
+    // The bytes are gathered into page aligned blocks, a full block is written while the next one is filled
+    auto out = BlockFileWriter{ path, mode };
+    for ( auto b : bytes )
+    {
+        out.put( static_cast<std::byte>( b ) );
+    }
+    out.close();
+}
+
+auto read( std::string path, IoMode mode = IoMode::Buffered ) -> MyGenerator<std::uint8_t>
+{
+    // The next block is read while the bytes of this one are decoded
+    auto in = BlockFileReader{ path, mode };
+    for ( auto block = in.next_block(); !block.empty(); block = in.next_block() )
+    {
+        for ( auto b : block )
+        {
+            co_yield static_cast<std::uint8_t>( b );
+        }
+    }
+}
+
+// Variable byte and gap decoding straight over the blocks of a file, without a coroutine per byte.
+// A number can straddle two blocks, so the state is kept from one block to the next.
+class PostingsDecoder
+{
+public:
+    template <typename F>
+    void decode( std::span<const std::byte> block, F&& on_id )
+    {
+        for ( auto byte : block )
+        {
+            const auto b = static_cast<int>( byte );
+            if ( b < 128 ) // Check continuation bit
+            {
+                n_ += b * weight_;
+                weight_ *= 128;
+            }
+            else
+            {
+                n_ += ( b - 128 ) * weight_;
+                last_id_ += n_;
+                on_id( last_id_ );
+                n_ = 0;
+                weight_ = 1;
+            }
+        }
+    }
+
+private:
+    int n_{ 0 };
+    int weight_{ 1 };
+    int last_id_{ 0 };
+};
+
+template <typename F>
+void decompress( BlockFileReader& in, F&& on_id )
 {
-    auto out = std::ofstream{ path, std::ios::out | std::ofstream::binary };
-    std::ranges::copy( bytes.begin(), bytes.end(), std::ostreambuf_iterator<char>( out ) );
+    auto decoder = PostingsDecoder{};
+    for ( auto block = in.next_block(); !block.empty(); block = in.next_block() )
+    {
+        decoder.decode( block, on_id ); // The next block is read meanwhile
+    }
 }
 
-auto read( std::string path ) -> MyGenerator<std::uint8_t>
+// Byte by byte through the stream buffer, for comparison
+auto read_stream( std::string path ) -> MyGenerator<std::uint8_t>
 {
     auto in = std::ifstream{ path, std::ios::in | std::ofstream::binary };
     auto it = std::istreambuf_iterator<char>{ in };
     const auto end = std::istreambuf_iterator<char>{};
     for ( ; it != end; ++it )
     {
-        co_yield *it;
+        co_yield static_cast<std::uint8_t>( *it );
     }
 }
 
@@ -380,6 +460,15 @@ void Generator()
     }
     std::cout << '\n';
 
+    {
+        auto frame = ScratchFrame{}; // The vector's memory is released with the frame
+        for ( auto v : lin_space_eager( 2.0, 3.0, 5, ScratchAllocator<double>{} ) )
+        {
+            std::cout << v << ", ";
+        }
+        std::cout << '\n';
+    }
+
     //-------------------------------------------------------------------------
 
     // this lambda can return a bool to indicate if user want more values.
@@ -414,6 +503,17 @@ void Generator()
     }
     std::cout << '\n';
 
+    {
+        auto frame = ScratchFrame{}; // The coroutine frame is taken from the scratch arena
+        auto values = lin_space_coroutine( std::allocator_arg, ScratchAllocator<std::byte>{}, 2.0, 3.0, 5 );
+        std::cout << "frame of " << ScratchArena::current().used() << " bytes in the scratch arena: ";
+        for ( auto v : values )
+        {
+            std::cout << v << ", ";
+        }
+        std::cout << '\n';
+    }
+
     //-------------------------------------------------------------------------
 
     auto ids = std::array{ 10, 11, 12, 14 };
@@ -445,5 +545,101 @@ void Generator()
         {
             std::cout << doc << ", ";
         }
+        std::cout << '\n';
+    }
+
+    // A larger posting list, to see the I/O
+    {
+        auto documents = std::vector<int>( 16'000'000 );
+        for ( auto i = size_t{ 0 }; i < documents.size(); ++i )
+        {
+            documents[i] = static_cast<int>( i * 100 ); // Gaps of 100, 1 byte each
+        }
+        auto bytes = compress( documents );
+        write( "postings.bin", bytes );
+        const auto file_size = std::filesystem::file_size( "postings.bin" );
+        std::cout << "postings.bin: " << file_size << " bytes\n";
+
+        const auto options = BenchmarkOptions{ .max_total_time = std::chrono::seconds{ 2 }, .min_samples = 3 };
+        const auto print_throughput = [ & ] ( const BenchmarkResult& r )
+        {
+            std::cout << "    " << static_cast<double>( file_size ) / r.median_ns_ << " GB/s\n";
+        };
+
+        // The I/O alone: every byte is read (xor-ed together), nothing decoded.
+        // The buffered runs read from the page cache (the file was just written), the direct ones from the device.
+        auto checksum = std::uint8_t{ 0 };
+        print_throughput( run_benchmark( "istreambuf_iterator (I/O only)", [ & ]
+        {
+            auto in = std::ifstream{ "postings.bin", std::ios::in | std::ifstream::binary };
+            auto x = std::uint8_t{ 0 };
+            for ( auto it = std::istreambuf_iterator<char>{ in }; it != std::istreambuf_iterator<char>{}; ++it )
+            {
+                x ^= static_cast<std::uint8_t>( *it );
+            }
+            checksum = x;
+        }, options ) );
+        print_throughput( run_benchmark( "ifstream::read, 1 MiB blocks (I/O only)", [ & ]
+        {
+            auto in = std::ifstream{ "postings.bin", std::ios::in | std::ifstream::binary };
+            auto buffer = std::vector<char>( size_t{ 1 } << 20 );
+            auto x = std::uint8_t{ 0 };
+            while ( in.read( buffer.data(), static_cast<std::streamsize>( buffer.size() ) ) || in.gcount() > 0 )
+            {
+                for ( auto i = std::streamsize{ 0 }; i < in.gcount(); ++i )
+                {
+                    x ^= static_cast<std::uint8_t>( buffer[static_cast<size_t>( i )] );
+                }
+            }
+            checksum = x;
+        }, options ) );
+        for ( auto mode : { IoMode::Buffered, IoMode::Direct } )
+        {
+            print_throughput( run_benchmark( mode == IoMode::Buffered ? "BlockFileReader, buffered (I/O only)" : "BlockFileReader, direct (I/O only)", [ & ]
+            {
+                auto in = BlockFileReader{ "postings.bin", mode };
+                auto x = std::uint8_t{ 0 };
+                for ( auto block = in.next_block(); !block.empty(); block = in.next_block() )
+                {
+                    for ( auto b : block )
+                    {
+                        x ^= static_cast<std::uint8_t>( b );
+                    }
+                }
+                checksum = x;
+            }, options ) );
+        }
+        DoNotOptimize( checksum );
+
+        // Read and decoded: a coroutine per byte (and per gap) costs more than the I/O itself,
+        // decoding the blocks in place is what lets the faster reads show
+        auto count = size_t{ 0 };
+        print_throughput( run_benchmark( "istreambuf_iterator + generators", [ & ]
+        {
+            count = 0;
+            auto bytes = read_stream( "postings.bin" );
+            for ( auto doc : decompress( bytes ) )
+            {
+                DoNotOptimize( doc );
+                ++count;
+            }
+        }, options ) );
+        std::cout << "Decoded: " << count << '\n';
+        for ( auto mode : { IoMode::Buffered, IoMode::Direct } )
+        {
+            print_throughput( run_benchmark( mode == IoMode::Buffered ? "BlockFileReader, buffered + PostingsDecoder" : "BlockFileReader, direct + PostingsDecoder", [ & ]
+            {
+                count = 0;
+                auto in = BlockFileReader{ "postings.bin", mode };
+                decompress( in, [ & ] ( int doc )
+                {
+                    DoNotOptimize( doc );
+                    ++count;
+                } );
+            }, options ) );
+            std::cout << "Decoded: " << count << '\n';
+        }
+
+        std::filesystem::remove( "postings.bin" );
     }
 }
\ No newline at end of file
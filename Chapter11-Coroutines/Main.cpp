@@ -9,9 +9,11 @@ void SubroutinesAndCoroutines();
 void UseCoroutines();
 void Generator();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( SubroutinesAndCoroutines );
 	Entry( UseCoroutines );
 	Entry( Generator );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include <iostream>
 #include <thread>
 
+#include "CoroutineFramePool.h"
+
 // Compared to ordinary functions, a coroutine also has the following restrictions:
 // 
 // - A coroutine cannot use variadic arguments like f( const char*... ).
@@ -25,7 +27,7 @@
 // The Resumable is the owner of the coroutine state.
 class Resumable // The return object
 {
-	struct Promise // coroutine state
+	struct Promise : PoolAllocatedFrame // coroutine state
 	{
 		// We should not call these functions directly;
 		// instead, the compiler inserts calls to the promise objects when it transforms a coroutine into machine code.
@@ -49,15 +51,17 @@ class Resumable // The return object
 			std::terminate();
 		}
 
+		// The frames are recycled by the frame pool (see CoroutineFramePool.h)
+		using PoolAllocatedFrame::operator new; // The std::allocator_arg_t versions
 		static void* operator new( std::size_t sz )
 		{
 			std::cout << "\ncustom new for size " << sz << '\n';
-			return ::operator new( sz );
+			return PoolAllocatedFrame::operator new( sz );
 		}
-		static void operator delete( void* ptr )
+		static void operator delete( void* ptr, std::size_t sz )
 		{
 			std::cout << "\ncustom delete called\n";
-			::operator delete( ptr );
+			PoolAllocatedFrame::operator delete( ptr, sz );
 		}
 	};    
 	// Nested class, see below
@@ -3,10 +3,15 @@
 #include <boost/asio/awaitable.hpp>
 #include <boost/asio/use_awaitable.hpp>
 
+#include "LatencyHistogram.h"
+
 using namespace std::chrono;
 namespace asio = boost::asio;
 using boost::asio::ip::tcp;
 
+// Per request latency of every session, all sessions run on the io_context thread
+auto request_latency = LatencyHistogram{};
+
 auto serve_client( tcp::socket socket ) -> asio::awaitable<void>
 {
     std::cout << "New client connected\n";
@@ -17,9 +22,13 @@ auto serve_client( tcp::socket socket ) -> asio::awaitable<void>
     {
         try
         {
-            auto s = std::to_string( counter ) + "\n";
-            auto buf = asio::buffer( s.data(), s.size() );
-            auto n = co_await async_write( socket, buf, asio::use_awaitable );
+            auto n = size_t{ 0 };
+            {
+                auto latency = ScopedLatency{ request_latency };
+                auto s = std::to_string( counter ) + "\n";
+                auto buf = asio::buffer( s.data(), s.size() );
+                n = co_await async_write( socket, buf, asio::use_awaitable );
+            }
             std::cout << "Wrote " << n << " byte(s)\n";
             ++counter;
             timer.expires_from_now( 100ms );
@@ -31,6 +40,7 @@ auto serve_client( tcp::socket socket ) -> asio::awaitable<void>
             break;
         }
     }
+    request_latency.print( std::cout, "serve_client request" );
 }
 
 auto listen( tcp::endpoint endpoint ) -> asio::awaitable<void>
@@ -7,6 +7,9 @@
 
 #include <boost/asio.hpp>
 
+#include "CoroutineFramePool.h"
+#include "LatencyHistogram.h"
+
 namespace asio = boost::asio;
 
 // Note: The standard library already provides a type that allows a function
@@ -26,7 +29,7 @@ namespace asio = boost::asio;
 template <typename T>
 class [[nodiscard]] Task
 {
-    struct Promise
+    struct Promise : PoolAllocatedFrame // Every co_await of a Task creates a frame, recycle them
     {
         // use std::monostate to make variant default constructible
         std::variant<std::monostate, T, std::exception_ptr> result_;
@@ -136,7 +139,7 @@ public:
 template <>
 class [[nodiscard]] Task<void>
 {
-    struct Promise
+    struct Promise : PoolAllocatedFrame
     {
         std::exception_ptr e_; // No std::variant, only exception
         std::coroutine_handle<> continuation_;
@@ -210,7 +213,7 @@ namespace detail
     template <typename T>
     class SyncWaitTask // A helper class only used by sync_wait()
     {
-        struct Promise
+        struct Promise : PoolAllocatedFrame
         {
             T* value_{ nullptr };
             std::exception_ptr error_{ nullptr };
@@ -290,9 +293,18 @@ namespace detail
     };
 }
 
+// How long callers block in sync_wait(), shared by every instantiation
+inline auto sync_wait_latency() -> ConcurrentLatencyHistogram&
+{
+    static auto histogram = ConcurrentLatencyHistogram{};
+    return histogram;
+}
+
 template <typename T>
 Result<T> sync_wait( T&& task )
 {
+    auto latency = ScopedLatency{ sync_wait_latency() };
+
     if constexpr ( std::is_void_v<Result<T>> )
     {
         struct Empty
@@ -346,7 +358,7 @@ auto area() -> Task<int>
 // This code is here just to get our example up and running
 struct Detached
 {
-    struct promise_type
+    struct promise_type : PoolAllocatedFrame
     {
         auto get_return_object()
         {
@@ -434,6 +446,17 @@ void AsyncTask()
 
     std::cout << value << "\n";
 
+    // The frames of area(), height(), width() and sync_wait()'s helper are recycled by the frame pool,
+    // the loop doesn't allocate any of them from the heap
+    const auto heap_frames = CoroutineFramePool::heap_allocations();
+    for ( auto i = 0; i < 10'000; ++i )
+    {
+        auto task = area();
+        value = sync_wait( task );
+    }
+    sync_wait_latency().print( std::cout, "sync_wait" );
+    std::cout << "coroutine frames taken from the heap: " << CoroutineFramePool::heap_allocations() - heap_frames << '\n';
+
     //-------------------------------------------------------------------------
 
     using namespace std::chrono_literals;
@@ -12,10 +12,12 @@ void AsyncTask();
 void AsyncTCP();
 void TailCallOptimization();
 
-int main()
+int main( int argc, char** argv )
 {
 	// Entry( Await );
 	// Entry( AsyncTask );
 	// Entry( AsyncTCP );
 	Entry( TailCallOptimization );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
@@ -3,6 +3,12 @@
 #include <thread>
 #include <vector>
 #include <future>
+#include <numeric>
+#include <memory_resource>
+#include <iostream>
+
+#include "Benchmark.h"
+#include "ConcurrentArena.h"
 
 // first approach: use atomic
 //-------------------------------------------------------------------------
@@ -86,9 +92,110 @@ auto par_copy_if_split( SrcIt first, SrcIt last, DstIt dst,
     return new_end;
 }
 
+// third approach: copy into temporary buffers, then into place
+//-------------------------------------------------------------------------
+
+// Unlike the split version, the destination only needs room for the result.
+// Each task copies its chunk into a buffer of its own, and once the sizes are known,
+// each buffer is moved to its final position in parallel.
+// The buffers are allocated from resource, a ConcurrentArena lets the tasks allocate them without malloc.
+// They grow as the matches come (the size isn't known up front), so every task makes a series of
+// allocations, from a few bytes to a few hundred KiB.
+template <typename SrcIt, typename DstIt, typename Pred>
+auto par_copy_if_buffered( SrcIt first, SrcIt last, DstIt dst,
+                           Pred pred, size_t chunk_sz, std::pmr::memory_resource* resource ) -> DstIt
+{
+    using T = typename std::iterator_traits<SrcIt>::value_type;
+    using Buffer = std::pmr::vector<T>;
+
+    // Part #1: Copy each chunk into its buffer
+    const auto n = static_cast<size_t>( std::distance( first, last ) );
+    auto futures = std::vector<std::future<Buffer>>{};
+    futures.reserve( ( n + chunk_sz - 1 ) / chunk_sz );
+    for ( auto i = size_t{ 0 }; i < n; i += chunk_sz )
+    {
+        const auto stop_idx = std::min( i + chunk_sz, n );
+        futures.emplace_back( std::async( std::launch::async, [ =, &pred ]
+        {
+            auto buffer = Buffer{ resource };
+            std::copy_if( first + i, first + stop_idx, std::back_inserter( buffer ), pred );
+            return buffer;
+        } ) );
+    }
+    auto buffers = std::vector<Buffer>{};
+    buffers.reserve( futures.size() );
+    for ( auto&& future : futures )
+    {
+        buffers.push_back( future.get() );
+    }
+
+    // Part #2: Move the buffers to their offsets
+    auto offsets = std::vector<size_t>( buffers.size() + 1 );
+    std::transform_inclusive_scan( buffers.begin(), buffers.end(), offsets.begin() + 1, std::plus<>{},
+                                   [] ( const Buffer& b ) { return b.size(); } );
+    auto moves = std::vector<std::future<void>>{};
+    moves.reserve( buffers.size() );
+    for ( auto i = size_t{ 0 }; i < buffers.size(); ++i )
+    {
+        moves.emplace_back( std::async( std::launch::async, [ &buffers, &offsets, dst, i ]
+        {
+            std::move( buffers[i].begin(), buffers[i].end(), dst + offsets[i] );
+        } ) );
+    }
+    for ( auto&& move : moves )
+    {
+        move.wait();
+    }
+    return dst + offsets.back();
+}
+
 //-------------------------------------------------------------------------
 
 void CopyIf()
 {
+    const auto n = 10'000'000;
+    auto src = std::vector<int>( n );
+    std::iota( src.begin(), src.end(), 0 );
+    auto dst = std::vector<int>( n );
+    auto pred = [ n ] ( int v )
+    {
+        return v % 3 == 0 || v > n / 2; // About 2 / 3 of the values
+    };
+    constexpr auto chunk_sz = size_t{ 100'000 };
+    const auto options = BenchmarkOptions{ .max_total_time = std::chrono::seconds{ 1 }, .min_samples = 5 };
 
+    auto count = std::ptrdiff_t{};
+    run_benchmark( "std::copy_if", [ & ]
+    {
+        count = std::copy_if( src.begin(), src.end(), dst.begin(), pred ) - dst.begin();
+        DoNotOptimize( dst.data() );
+    }, options );
+    std::cout << "Copied: " << count << '\n';
+
+    run_benchmark( "par_copy_if_split", [ & ]
+    {
+        count = par_copy_if_split( src.begin(), src.end(), dst.begin(), pred, chunk_sz ) - dst.begin();
+        DoNotOptimize( dst.data() );
+    }, options );
+    std::cout << "Copied: " << count << '\n';
+
+    run_benchmark( "par_copy_if_buffered (new_delete_resource)", [ & ]
+    {
+        count = par_copy_if_buffered( src.begin(), src.end(), dst.begin(), pred, chunk_sz, std::pmr::new_delete_resource() ) - dst.begin();
+        DoNotOptimize( dst.data() );
+    }, options );
+    std::cout << "Copied: " << count << '\n';
+
+    // A buffer grown by doubling takes up to twice its final capacity from a monotonic arena, which is itself
+    // up to twice its size: room for one run is about 4 * n * sizeof( int ), plus the threads' partly used pieces
+    auto arena = ConcurrentArena{ 4 * n * sizeof( int ) + ( n / chunk_sz + 1 ) * ConcurrentArena::chunk_size };
+    auto overflows = size_t{ 0 };
+    run_benchmark( "par_copy_if_buffered (ConcurrentArena)", [ & ]
+    {
+        count = par_copy_if_buffered( src.begin(), src.end(), dst.begin(), pred, chunk_sz, &arena ) - dst.begin();
+        DoNotOptimize( dst.data() );
+        overflows = std::max( overflows, arena.overflow_allocations() );
+        arena.reset(); // The tasks are joined, the phase is over
+    }, options );
+    std::cout << "Copied: " << count << ", allocations that didn't fit in the arena: " << overflows << '\n';
 }
\ No newline at end of file
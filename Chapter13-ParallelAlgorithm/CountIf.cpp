@@ -5,6 +5,8 @@
 #include <iostream>
 
 #include "ScopeTimer.h"
+#include "Benchmark.h"
+#include "AlignedAllocator.h"
 
 //-------------------------------------------------------------------------
 
@@ -13,12 +15,16 @@ auto par_count_if( It first, It last, Pred pred, size_t chunk_sz )
 {
     auto n = static_cast<size_t>( std::distance( first, last ) );
     if ( n <= chunk_sz )
+    {
+        TRACE_SCOPE( "par_count_if chunk" );
         return std::count_if( first, last, pred );
+    }
 
     auto middle = std::next( first, n / 2 );
 
     auto fut = std::async( std::launch::async, [ =, &pred ]
     {
+        TRACE_SCOPE( "par_count_if task" );
         return par_count_if( first, middle, pred, chunk_sz );
     } );
 
@@ -30,7 +36,7 @@ template <typename It, typename Pred>
 auto par_count_if( It first, It last, Pred pred )
 {
     auto n = static_cast<size_t>( std::distance( first, last ) );
-    auto n_cores = size_t{ std::thread::hardware_concurrency() };
+    auto n_cores = BenchmarkContext::threads(); // --threads, hardware concurrency by default
 
     auto chunk_sz = std::max( n / n_cores * 32, size_t{ 10'000 } );
 
@@ -39,7 +45,7 @@ auto par_count_if( It first, It last, Pred pred )
 
 auto setup_count_if( int n )
 {
-    auto src = std::vector<float>( n );
+    auto src = std::vector<float, AlignedAllocator<float>>( n ); // Cache line aligned, the chunks start on full vectors
     std::iota( src.begin(), src.end(), 1.0f );  // From 1.0 to n
 
     auto predicator = [n] ( float val )
@@ -56,9 +62,10 @@ void CountIf()
 
     auto sum = 0ll;
 
+    run_benchmark( "par_count_if", [ & ]
     {
-        auto timer = ScopedTimer{ "parallel count_if" };
-        sum = par_count_if(src.begin(), src.end(), pred );
-    }
+        sum = par_count_if( src.begin(), src.end(), pred );
+        DoNotOptimize( sum );
+    } );
     std::cout << "Sum = " << sum << '\n';
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <bit>
 #include <future>
 #include <numeric>
 #include <iostream>
@@ -10,6 +11,8 @@
 // - The other part is recursively processed at the calling thread
 
 #include "ScopeTimer.h"
+#include "Benchmark.h"
+#include "FirstTouchAllocator.h"
 
 //-------------------------------------------------------------------------
 
@@ -21,6 +24,7 @@ auto par_transform_dac( SrcIt first, SrcIt last, DstIt dst,
     const auto n = static_cast<size_t>( std::distance( first, last ) );
     if ( n <= chunk_sz )
     {
+        TRACE_SCOPE( "par_transform_dac chunk" );
         std::transform( first, last, dst, func );
         return;
     }
@@ -30,6 +34,7 @@ auto par_transform_dac( SrcIt first, SrcIt last, DstIt dst,
     // Branch of first part to another task
     auto future = std::async( std::launch::async, [ =, &func ]
     {
+        TRACE_SCOPE( "par_transform_dac task" );
         par_transform_dac( first, src_middle, dst, func, chunk_sz );
     } );
 
@@ -40,11 +45,17 @@ auto par_transform_dac( SrcIt first, SrcIt last, DstIt dst,
     future.wait();
 }
 
-auto setup( int n )
+// Halving until a part fits in chunk_sz leaves a power of two of equal chunks,
+// the vectors are faulted in and initialized with the same chunks
+auto setup( int n, size_t chunk_sz )
 {
-    auto src = std::vector<float>( n );
-    std::iota( src.begin(), src.end(), 1.0f );  // From 1.0 to n
-    auto dst = std::vector<float>( src.size() );
+    const auto n_tasks = std::bit_ceil( ( static_cast<size_t>( n ) + chunk_sz - 1 ) / chunk_sz );
+    auto src = UninitializedVector<float>( n, FirstTouchAllocator<float>{ n_tasks } );
+    for_each_chunk( src.size(), n_tasks, [ &src ] ( size_t start, size_t stop )
+    {
+        std::iota( src.begin() + start, src.begin() + stop, static_cast<float>( start + 1 ) );  // From 1.0 to n
+    } );
+    auto dst = UninitializedVector<float>( src.size(), FirstTouchAllocator<float>{ n_tasks } );
 
     // now the execution time of each task is completely uneven.
     auto transform_function = [] ( float v )
@@ -57,7 +68,7 @@ auto setup( int n )
         }
         return sum;
     };
-    return std::tuple{ src, dst, transform_function };
+    return std::tuple{ std::move( src ), std::move( dst ), transform_function };
 }
 
 void DivideAndConquer()
@@ -67,9 +78,13 @@ void DivideAndConquer()
     
     // More threads doesn't mean better, use thread pool is limit the number of worker threads.
     {
-        auto [src, dst, func] = setup( 1'000'000 );
+        constexpr auto chunk_sz = size_t{ 100'000 };
+        auto [src, dst, func] = setup( 1'000'000, chunk_sz );
 
-        auto timer = ScopedTimer{ "parallel" };
-        par_transform_dac( src.begin(), src.end(), dst.begin(), func, 100'000 );
+        run_benchmark( "par_transform_dac", [ & ]
+        {
+            par_transform_dac( src.begin(), src.end(), dst.begin(), func, chunk_sz );
+            DoNotOptimize( dst.data() );
+        }, BenchmarkOptions{ .max_total_time = std::chrono::seconds{ 1 }, .min_samples = 5 } );
     }
 }
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "MainEntryHelper.h"
 
+// The futures, task states and chunks allocated by many threads at once (std::async, the divide and conquer
+// algorithms) are served from thread caches instead of glibc's locked arenas. This replaces the global
+// operator new/delete for the whole program, comment it out and compare with --baseline to see the difference.
+#define THREAD_CACHING_ALLOCATOR_REPLACE_NEW
+#include "ThreadCachingAllocator.h"
+
 // Note: The efficiency also depends on the problem size and the number of cores.
 // For example, a parallel algorithm may perform very poorly
 // on small data sets due to the overhead incurred by the added complexity of a parallel algorithm.
@@ -26,11 +32,13 @@ void CountIf();
 void CopyIf();
 void StdLibrary();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( Transform );
 	Entry( DivideAndConquer );
 	Entry( CountIf );
 	Entry( CopyIf );
 	Entry( StdLibrary );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include <numeric>
 
 #include "ScopeTimer.h"
+#include "Benchmark.h"
+#include "FirstTouchAllocator.h"
 
 //-------------------------------------------------------------------------
 
@@ -12,7 +14,7 @@ template <typename SrcIt, typename DstIt, typename Func>
 auto par_transform_naive( SrcIt first, SrcIt last, DstIt dst, Func f )
 {
     auto n = static_cast<size_t>( std::distance( first, last ) );
-    auto n_cores = size_t{ std::thread::hardware_concurrency() };
+    auto n_cores = BenchmarkContext::threads(); // --threads, hardware concurrency by default
     auto n_tasks = std::max( n_cores, size_t{ 1 } );
     auto chunk_sz = ( n + n_tasks - 1 ) / n_tasks;
     auto futures = std::vector<std::future<void>>{};
@@ -26,6 +28,7 @@ auto par_transform_naive( SrcIt first, SrcIt last, DstIt dst, Func f )
             auto stop = std::min( chunk_sz * ( i + 1 ), n );
             auto fut = std::async( std::launch::async, [ first, dst, start, stop, f ] ()
             {
+                TRACE_SCOPE( "par_transform_naive chunk" );
                 std::transform( first + start, first + stop, dst + start, f );
             } );
             futures.emplace_back( std::move( fut ) );
@@ -39,12 +42,18 @@ auto par_transform_naive( SrcIt first, SrcIt last, DstIt dst, Func f )
     }
 }
 
+// The vectors are faulted in and initialized by the same chunks and number of tasks as par_transform_naive,
+// instead of being zeroed on the main thread first
 auto setup_fixture( int n )
 {
-    auto src = std::vector<float>( n );
-    std::iota( src.begin(), src.end(), 1.0f ); // Values from 1.0 to n
+    const auto n_tasks = BenchmarkContext::threads();
+    auto src = UninitializedVector<float>( n, FirstTouchAllocator<float>{ n_tasks } );
+    for_each_chunk( src.size(), n_tasks, [ &src ] ( size_t start, size_t stop )
+    {
+        std::iota( src.begin() + start, src.begin() + stop, static_cast<float>( start + 1 ) ); // Values from 1.0 to n
+    } );
 
-    auto dst = std::vector<float>( src.size() );
+    auto dst = UninitializedVector<float>( src.size(), FirstTouchAllocator<float>{ n_tasks } ); // Written by the transform
     auto transform_function = [] ( float v )
     {
         auto sum = v;
@@ -54,7 +63,7 @@ auto setup_fixture( int n )
         }
         return sum;
     };
-    return std::tuple{ src, dst, transform_function };
+    return std::tuple{ std::move( src ), std::move( dst ), transform_function };
 }
 
 void Transform()
@@ -66,17 +75,24 @@ void Transform()
     // However, for real situation, the execution time of a task might not be equal.
     // (i.e. computation time is not proportional to chunk size)
     // If the application and/or the operating system has other processes to handle, the operation will not process all chunks in parallel.
+    const auto options = BenchmarkOptions{ .max_total_time = std::chrono::seconds{ 1 }, .min_samples = 5 };
     {
         auto [src, dst, func] = setup_fixture( 1'000'000 );
 
-        auto timer = ScopedTimer{ "parallel" };
-        par_transform_naive( src.begin(), src.end(), dst.begin(), func );
+        run_benchmark( "par_transform_naive", [ & ]
+        {
+            par_transform_naive( src.begin(), src.end(), dst.begin(), func );
+            DoNotOptimize( dst.data() );
+        }, options );
     }
 
     {
         auto [src, dst, func] = setup_fixture( 1'000'000 );
 
-        auto timer = ScopedTimer{ "sequential" };
-        std::transform( src.begin(), src.end(), dst.begin(), func );
+        run_benchmark( "sequential transform", [ & ]
+        {
+            std::transform( src.begin(), src.end(), dst.begin(), func );
+            DoNotOptimize( dst.data() );
+        }, options );
     }
 }
\ No newline at end of file
@@ -63,8 +63,10 @@
 void BigONotation();
 void Timer();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( BigONotation );
 	Entry( Timer );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
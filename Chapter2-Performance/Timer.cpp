@@ -4,13 +4,18 @@
 
 #include "ScopeTimer.h"
 
-#define USE_TIMER 1
+// MEASURE_FUNCTION() lives in ScopeTimer.h, define USE_TIMER to 0 before including it to compile the timers out.
 
-#if USE_TIMER
-#define MEASURE_FUNCTION() ScopedTimer __timer{ std::source_location::current().function_name() } 
-#else 
-#define MEASURE_FUNCTION() 
-#endif
+void MyInnerFunc()
+{
+    MEASURE_FUNCTION();
+
+    auto total = 0ull;
+    for ( int i = 0; i < 10'000'000; ++i )
+    {
+        total += 12;
+    }
+}
 
 void MyFunc()
 {
@@ -21,9 +26,18 @@ void MyFunc()
     {
         total += 12;
     }
+    MyInnerFunc();
 }
 
 void Timer()
 {
     MyFunc();
-}
\ No newline at end of file
+
+    // Printing from every destructor skews the measurement and loses the nesting.
+    // Inside a trace session the same timers are recorded into per-thread buffers instead,
+    // and written to a trace file which can be opened in chrome://tracing or ui.perfetto.dev.
+    {
+        auto session = TraceSession{ "Chapter2-Performance.trace.json" };
+        MyFunc();
+    }
+}
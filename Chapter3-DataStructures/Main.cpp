@@ -17,11 +17,15 @@ void ComputerMemory();
 void Container();
 void View();
 void ParallelArray();
+void MemoryHierarchy();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( ComputerMemory );
 	Entry( Container );
 	Entry( View );
 	Entry( ParallelArray );
+	Entry( MemoryHierarchy );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
@@ -0,0 +1,286 @@
+// Probing the memory hierarchy.
+//
+// The same loop gets slower in steps as its working set outgrows each cache level.
+// Measuring where those steps are on this machine tells us how big a block, a node or a tile
+// of our data structures can be before it falls off a cliff.
+//
+// 1. Latency: a randomized pointer chase. Every load depends on the previous one and the
+//    order defeats the prefetchers, so the time per load is the latency of the level the
+//    working set fits in (TLB misses included once it spans more pages than the TLB covers).
+// 2. Bandwidth: sequential read, write and copy, single-threaded over a size sweep and
+//    multi-threaded over a buffer much larger than the last level cache.
+// 3. Traversal order: row-major vs column-major over a size sweep, the penalty appears as
+//    soon as a column of cache lines no longer fits in the cache.
+//
+// Every point is a run_benchmark(), so the curves also land in the --format=json/csv output.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+#include "CacheTopology.h"
+
+namespace
+{
+    // Each point only needs a rough median, keep the whole sweep within a few seconds
+    const auto sweep_options = BenchmarkOptions{
+        .warmup_time = std::chrono::milliseconds{ 20 },
+        .min_sample_time = std::chrono::milliseconds{ 1 },
+        .max_total_time = std::chrono::milliseconds{ 100 },
+        .min_samples = 5,
+        .max_samples = 50
+    };
+
+    // Don't sweep a 300 MiB L3 to twice its size in a demo
+    constexpr auto kMaxWorkingSet = size_t{ 128 } << 20;
+
+    auto format_size( size_t bytes ) -> std::string
+    {
+        if ( bytes >= ( size_t{ 1 } << 20 ) && bytes % ( size_t{ 1 } << 20 ) == 0 )
+            return std::to_string( bytes >> 20 ) + " MiB";
+        return std::to_string( bytes >> 10 ) + " KiB";
+    }
+
+    // Powers of two and the midpoints between them
+    auto size_sweep( size_t first, size_t last ) -> std::vector<size_t>
+    {
+        auto sizes = std::vector<size_t>{};
+        for ( auto size = first; size <= last; size *= 2 )
+        {
+            sizes.push_back( size );
+            if ( size + size / 2 <= last )
+            {
+                sizes.push_back( size + size / 2 );
+            }
+        }
+        return sizes;
+    }
+
+    //-------------------------------------------------------------------------
+
+    // One node per cache line, so every hop is a new line
+    struct alignas( 64 ) ChaseNode
+    {
+        ChaseNode* next_{};
+    };
+
+    // A single random cycle through all nodes (Sattolo's algorithm)
+    auto make_chase( size_t bytes ) -> std::unique_ptr<ChaseNode[]>
+    {
+        const auto n = std::max<size_t>( bytes / sizeof( ChaseNode ), 2 );
+        auto nodes = std::make_unique<ChaseNode[]>( n );
+        auto order = std::vector<size_t>( n );
+        std::iota( order.begin(), order.end(), size_t{ 0 } );
+        auto engine = std::mt19937_64{ 42 };
+        for ( auto i = n - 1; i > 0; --i )
+        {
+            const auto j = std::uniform_int_distribution<size_t>{ 0, i - 1 }( engine );
+            std::swap( order[i], order[j] );
+        }
+        for ( auto i = size_t{ 0 }; i < n; ++i )
+        {
+            nodes[order[i]].next_ = &nodes[order[( i + 1 ) % n]];
+        }
+        return nodes;
+    }
+
+    auto latency_sweep( const CacheTopology& topology ) -> void
+    {
+        std::cout << "\n-- load latency (random pointer chase) --\n";
+        constexpr auto kHops = size_t{ 1 } << 16;
+
+        const auto last = std::min( std::max( topology.last_level_cache_size() * 2, size_t{ 8 } << 20 ), kMaxWorkingSet );
+        auto curve = std::vector<std::pair<size_t, double>>{};
+        for ( auto size : size_sweep( 4 << 10, last ) )
+        {
+            auto nodes = make_chase( size );
+            auto p = &nodes[0];
+            const auto r = run_benchmark( "latency " + format_size( size ), [ & ]
+            {
+                for ( auto i = size_t{ 0 }; i < kHops; ++i )
+                {
+                    p = p->next_;
+                }
+                DoNotOptimize( p );
+            }, sweep_options );
+            if ( !r.samples_ns_.empty() )
+            {
+                curve.emplace_back( size, r.median_ns_ / kHops );
+            }
+        }
+
+        std::cout << "\nworking set    ns/load\n";
+        for ( auto i = size_t{ 0 }; i < curve.size(); ++i )
+        {
+            char buf[64];
+            std::snprintf( buf, sizeof( buf ), "%10s %10.2f", format_size( curve[i].first ).c_str(), curve[i].second );
+            std::cout << buf;
+            // A step of more than 30% marks the end of a level
+            if ( i > 0 && curve[i].second > curve[i - 1].second * 1.3 )
+            {
+                std::cout << "   <- step, keep blocks below " << format_size( curve[i - 1].first );
+            }
+            std::cout << '\n';
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    auto read_buffer( const std::uint64_t* data, size_t n ) -> std::uint64_t
+    {
+        // Independent accumulators, so the adds don't serialize the loads
+        auto s0 = std::uint64_t{ 0 }, s1 = std::uint64_t{ 0 }, s2 = std::uint64_t{ 0 }, s3 = std::uint64_t{ 0 };
+        for ( auto i = size_t{ 0 }; i + 4 <= n; i += 4 )
+        {
+            s0 += data[i];
+            s1 += data[i + 1];
+            s2 += data[i + 2];
+            s3 += data[i + 3];
+        }
+        return s0 + s1 + s2 + s3;
+    }
+
+    auto print_bandwidth( const BenchmarkResult& r, size_t bytes_per_iteration ) -> void
+    {
+        if ( r.samples_ns_.empty() )
+        {
+            return;
+        }
+        char buf[64];
+        std::snprintf( buf, sizeof( buf ), "    %.2f GB/s\n", static_cast<double>( bytes_per_iteration ) / r.median_ns_ );
+        std::cout << buf;
+    }
+
+    auto bandwidth_sweep( const CacheTopology& topology ) -> void
+    {
+        std::cout << "\n-- single thread bandwidth --\n";
+        const auto last = std::min( std::max( topology.last_level_cache_size() * 4, size_t{ 32 } << 20 ), kMaxWorkingSet );
+
+        for ( auto size = size_t{ 16 } << 10; size <= last; size *= 4 )
+        {
+            const auto n = size / sizeof( std::uint64_t );
+            auto src = std::vector<std::uint64_t>( n, 1 );
+            auto dst = std::vector<std::uint64_t>( n );
+
+            print_bandwidth( run_benchmark( "read " + format_size( size ), [ & ]
+            {
+                DoNotOptimize( read_buffer( src.data(), n ) );
+            }, sweep_options ), size );
+
+            print_bandwidth( run_benchmark( "write " + format_size( size ), [ & ]
+            {
+                std::fill( dst.begin(), dst.end(), std::uint64_t{ 2 } );
+                DoNotOptimize( dst.data() );
+            }, sweep_options ), size );
+
+            // Copy reads and writes every byte
+            print_bandwidth( run_benchmark( "copy " + format_size( size ), [ & ]
+            {
+                std::memcpy( dst.data(), src.data(), size );
+                DoNotOptimize( dst.data() );
+            }, sweep_options ), 2 * size );
+        }
+
+        // One core usually can't saturate the memory bus, several can
+        const auto threads = BenchmarkContext::threads();
+        const auto size = last;
+        const auto n = size / sizeof( std::uint64_t );
+        const auto chunk = n / threads;
+        auto src = std::vector<std::uint64_t>( n, 1 );
+        auto dst = std::vector<std::uint64_t>( n );
+        std::cout << "\n-- " << threads << " thread(s) bandwidth, " << format_size( size ) << " --\n";
+
+        const auto parallel = [ & ] ( auto&& work )
+        {
+            auto workers = std::vector<std::jthread>{};
+            for ( auto t = size_t{ 0 }; t < threads; ++t )
+            {
+                workers.emplace_back( work, t * chunk );
+            }
+        };
+        print_bandwidth( run_benchmark( "parallel read " + format_size( size ), [ & ]
+        {
+            parallel( [ & ] ( size_t first )
+            {
+                DoNotOptimize( read_buffer( src.data() + first, chunk ) );
+            } );
+        }, sweep_options ), chunk * threads * sizeof( std::uint64_t ) );
+        print_bandwidth( run_benchmark( "parallel write " + format_size( size ), [ & ]
+        {
+            parallel( [ & ] ( size_t first )
+            {
+                std::fill_n( dst.data() + first, chunk, std::uint64_t{ 2 } );
+                DoNotOptimize( dst.data() );
+            } );
+        }, sweep_options ), chunk * threads * sizeof( std::uint64_t ) );
+        print_bandwidth( run_benchmark( "parallel copy " + format_size( size ), [ & ]
+        {
+            parallel( [ & ] ( size_t first )
+            {
+                std::memcpy( dst.data() + first, src.data() + first, chunk * sizeof( std::uint64_t ) );
+                DoNotOptimize( dst.data() );
+            } );
+        }, sweep_options ), 2 * chunk * threads * sizeof( std::uint64_t ) );
+    }
+
+    //-------------------------------------------------------------------------
+
+    auto traversal_sweep() -> void
+    {
+        std::cout << "\n-- row-major vs column-major traversal --\n";
+        auto curve = std::vector<std::tuple<size_t, double, double>>{};
+        for ( auto dim = size_t{ 64 }; dim * dim * sizeof( int ) <= kMaxWorkingSet / 2; dim *= 2 )
+        {
+            auto matrix = std::vector<int>( dim * dim, 1 );
+            const auto elements = static_cast<double>( dim * dim );
+
+            const auto row = run_benchmark( "row-major " + std::to_string( dim ) + "x" + std::to_string( dim ), [ & ]
+            {
+                auto sum = 0;
+                for ( auto i = size_t{ 0 }; i < dim; ++i )
+                    for ( auto j = size_t{ 0 }; j < dim; ++j )
+                        sum += matrix[i * dim + j];
+                DoNotOptimize( sum );
+            }, sweep_options );
+            const auto column = run_benchmark( "column-major " + std::to_string( dim ) + "x" + std::to_string( dim ), [ & ]
+            {
+                auto sum = 0;
+                for ( auto j = size_t{ 0 }; j < dim; ++j )
+                    for ( auto i = size_t{ 0 }; i < dim; ++i )
+                        sum += matrix[i * dim + j];
+                DoNotOptimize( sum );
+            }, sweep_options );
+            if ( !row.samples_ns_.empty() && !column.samples_ns_.empty() )
+            {
+                curve.emplace_back( dim, row.median_ns_ / elements, column.median_ns_ / elements );
+            }
+        }
+
+        std::cout << "\n  matrix      size   row ns/elem   col ns/elem   penalty\n";
+        for ( const auto& [dim, row, column] : curve )
+        {
+            char buf[96];
+            std::snprintf( buf, sizeof( buf ), "%8zux%-5zu %8s %13.3f %13.3f %8.1fx\n",
+                           dim, dim, format_size( dim * dim * sizeof( int ) ).c_str(), row, column, column / row );
+            std::cout << buf;
+        }
+    }
+}
+
+void MemoryHierarchy()
+{
+    const auto& topology = cache_topology();
+    print_cache_topology( std::cout, topology );
+
+    latency_sweep( topology );
+    bandwidth_sweep( topology );
+    traversal_sweep();
+}
@@ -2,8 +2,15 @@
 #include <array>
 #include <iostream>
 #include <chrono>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <random>
 
-#include "ScopeTimer.h"
+#include "Benchmark.h"
+#include "PerfCounters.h"
+#include "MappedFileResource.h"
+#include "SlotMap.h"
 
 // PallelArray is to trun AoS(Array of structure) to SoA(Structure of arrays)!
 // Pros:
@@ -32,8 +39,6 @@ struct BigObject
 template <class T>
 auto sum_scores( const std::vector<T>& objects )
 {
-	ScopedTimer t{ "sum_scores" };
-
 	auto sum = 0;
 	for ( const auto& obj : objects )
 	{
@@ -71,11 +76,9 @@ struct SUser
     bool is_playing_{};
 };
 
-template <class User>
-auto num_users_at_level( const std::vector<User>& users, short level )
+template <class Users>
+auto num_users_at_level( const Users& users, short level )
 {
-    ScopedTimer t{ "num_users_at_level (using 128 bytes User)" };
-
     auto num_users = 0;
     for ( const auto& user : users )
         if ( user.level_ == level )
@@ -83,11 +86,9 @@ auto num_users_at_level( const std::vector<User>& users, short level )
     return num_users;
 }
 
-template <class User>
-auto num_playing_users( const std::vector<User>& users )
+template <class Users>
+auto num_playing_users( const Users& users )
 {
-    ScopedTimer t{ "num_playing_users (using 128 bytes User)" };
-
     return std::count_if( users.begin(), users.end(),
                           [] ( const auto& user )
     {
@@ -97,13 +98,11 @@ auto num_playing_users( const std::vector<User>& users )
 
 auto num_users_at_level_parallel( const std::vector<short>& users, short level )
 {
-    ScopedTimer t{ "num_users_at_level using short vector" };
     return std::count( users.begin(), users.end(), level );
 }
 
 auto num_playing_users_parallel( const std::vector<bool>& users )
 {
-    ScopedTimer t{ "num_playing_users using vector<bool>" };
     return std::count( users.begin(), users.end(), true );
 }
 
@@ -116,23 +115,63 @@ void ParallelArray()
 	auto big_objects = std::vector<BigObject>( 1'000'000 );
 
 	// we want to sum the score of all objects
-    auto score = sum_scores( small_objects );
+    auto score = 0;
+    run_benchmark( "sum_scores (SmallObject)", [ & ]
+    {
+        score = sum_scores( small_objects );
+        DoNotOptimize( score );
+    } );
     std::cout << "Small object sum score: " << score << '\n';
-    score = sum_scores( big_objects );
+    run_benchmark( "sum_scores (BigObject)", [ & ]
+    {
+        score = sum_scores( big_objects );
+        DoNotOptimize( score );
+    } );
     std::cout << "Large object sum score: " << score << '\n';
 
+    // Same number of instructions, but BigObject only uses 4 bytes out of every 260 bytes loaded,
+    // so nearly every score read is a cache miss.
+    {
+        auto counters = ScopedPerfCounters{ "sum_scores (SmallObject)" };
+        score = sum_scores( small_objects );
+    }
+    {
+        auto counters = ScopedPerfCounters{ "sum_scores (BigObject)" };
+        score = sum_scores( big_objects );
+    }
+
     auto users = std::vector<User>( 1'000'000 );
-    auto res0 = num_users_at_level( users, 0 );
+    auto res0 = 0;
+    run_benchmark( "num_users_at_level (using 128 bytes User)", [ & ]
+    {
+        res0 = num_users_at_level( users, 0 );
+        DoNotOptimize( res0 );
+    } );
     std::cout << "Users At Level 0: " << res0 << '\n';
-    auto res1 = num_playing_users( users );
+    auto res1 = std::ptrdiff_t{};
+    run_benchmark( "num_playing_users (using 128 bytes User)", [ & ]
+    {
+        res1 = num_playing_users( users );
+        DoNotOptimize( res1 );
+    } );
     std::cout << "Count of playing users: " << res1 << '\n';
 
     std::cout << "\n------After Small User Optimization------\n\n";
 
     auto susers = std::vector<SUser>( 1'000'000 );
-    auto res2 = num_users_at_level( susers, 0 );
+    auto res2 = 0;
+    run_benchmark( "num_users_at_level (using SUser)", [ & ]
+    {
+        res2 = num_users_at_level( susers, 0 );
+        DoNotOptimize( res2 );
+    } );
     std::cout << "SUsers At Level 0: " << res2 << '\n';
-    auto res3 = num_playing_users( susers );
+    auto res3 = std::ptrdiff_t{};
+    run_benchmark( "num_playing_users (using SUser)", [ & ]
+    {
+        res3 = num_playing_users( susers );
+        DoNotOptimize( res3 );
+    } );
     std::cout << "Count of playing susers: " << res3 << '\n';
 
     std::cout << "\n------Use Parallel Array------\n\n";
@@ -140,8 +179,89 @@ void ParallelArray()
     auto levels = std::vector<short>( 1'000'000 );
     auto playing_users = std::vector<bool>( 1'000'000 );
 
-    auto res4 = num_users_at_level_parallel( levels, 0 );
+    auto res4 = std::ptrdiff_t{};
+    run_benchmark( "num_users_at_level using short vector", [ & ]
+    {
+        res4 = num_users_at_level_parallel( levels, 0 );
+        DoNotOptimize( res4 );
+    } );
     std::cout << "Users At Level 0: " << res4 << '\n';
-    auto res5 = num_playing_users_parallel( playing_users );
+    auto res5 = std::ptrdiff_t{};
+    run_benchmark( "num_playing_users using vector<bool>", [ & ]
+    {
+        res5 = num_playing_users_parallel( playing_users );
+        DoNotOptimize( res5 );
+    } );
     std::cout << "Count of playing susers: " << res5 << '\n';
+
+    // The levels don't have to be rebuilt at every start: built once in a mapped file,
+    // the next start only maps the file and the OS reads the pages in as they are used.
+    // A file left by a build with another layout (compiler, flags, or layout_tag) is started over.
+    {
+        const auto path = std::filesystem::temp_directory_path() / "levels.bin";
+        auto file = MappedFileResource{ path, MappedFileOptions{ .layout_tag = 1, .recreate_if_incompatible = true } };
+        auto* mapped_levels = file.root<PersistentVector<short>>();
+        if ( mapped_levels == nullptr )
+        {
+            mapped_levels = &file.construct_root<PersistentVector<short>>( MappedFileAllocator<short>{ file } );
+            mapped_levels->assign( levels.begin(), levels.end() );
+            std::cout << "Built " << mapped_levels->size() << " levels in " << path.string() << '\n';
+        }
+        else
+        {
+            std::cout << "Reopened " << mapped_levels->size() << " levels from " << path.string() << '\n';
+        }
+        auto res6 = std::ptrdiff_t{};
+        run_benchmark( "num_users_at_level using a mapped short vector", [ & ]
+        {
+            res6 = std::count( mapped_levels->begin(), mapped_levels->end(), short{ 0 } );
+            DoNotOptimize( res6 );
+        } );
+        std::cout << "Users At Level 0: " << res6 << '\n';
+    }
+
+    std::cout << "\n------Use Slot Map------\n\n";
+
+    // Users log in and out. Heap allocated users end up scattered in memory and a std::vector<SUser> can't erase
+    // without invalidating the indices held elsewhere. A slot map keeps the users packed and hands out
+    // handles instead, which find out when their user is gone.
+    auto user_map = SlotMap<SUser>{};
+    user_map.reserve( 1'000'000 );
+    auto handles = std::vector<SlotMap<SUser>::handle_type>{};
+    auto heap_users = std::vector<std::unique_ptr<SUser>>{};
+    for ( auto i = 0; i < 1'000'000; ++i )
+    {
+        auto user = SUser{};
+        user.level_ = static_cast<short>( i % 100 );
+        heap_users.push_back( std::make_unique<SUser>() );
+        heap_users.back()->level_ = user.level_;
+        handles.push_back( user_map.insert( std::move( user ) ) );
+    }
+    for ( auto i = 0; i < 1'000'000; i += 3 )
+    {
+        user_map.erase( handles[i] );
+        heap_users[i].reset();
+    }
+    std::erase( heap_users, nullptr );
+    std::shuffle( heap_users.begin(), heap_users.end(), std::mt19937{} ); // No longer in allocation order
+    std::cout << "Erased user found: " << std::boolalpha << ( user_map.find( handles[0] ) != nullptr )
+              << ", live user level: " << user_map[handles[1]].level_ << '\n';
+
+    auto res7 = 0;
+    run_benchmark( "num_users_at_level (SUser in a slot map)", [ & ]
+    {
+        res7 = num_users_at_level( user_map, 0 );
+        DoNotOptimize( res7 );
+    } );
+    std::cout << "Users At Level 0: " << res7 << '\n';
+    auto res8 = std::ptrdiff_t{};
+    run_benchmark( "num_users_at_level (SUser on the heap)", [ & ]
+    {
+        res8 = std::count_if( heap_users.begin(), heap_users.end(), [] ( const auto& user )
+        {
+            return user->level_ == 0;
+        } );
+        DoNotOptimize( res8 );
+    } );
+    std::cout << "Users At Level 0: " << res8 << '\n';
 }
\ No newline at end of file
@@ -10,10 +10,12 @@ void PartialSort();
 // 1. loop unrolling (one inspect into four inspects)
 // 2. 'Compare with zero' optimization.
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( DifferenceOfCpp20 );
 	Entry( Algorithm );
 	Entry( IteratorAndRanges );
 	Entry( PartialSort );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
@@ -4,8 +4,10 @@
 void LazyEvalViews();
 void ViewsBefore();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( LazyEvalViews );
 	Entry( ViewsBefore );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
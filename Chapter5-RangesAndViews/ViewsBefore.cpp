@@ -4,6 +4,10 @@
 #include <string>
 #include <fstream>
 #include <cassert>
+#include <memory_resource>
+
+#include "Benchmark.h"
+#include "ScratchArena.h"
 
 auto reset( std::span<int> values, int n )
 {
@@ -37,6 +41,20 @@ auto split( std::string_view s, char delim )
 		| std::views::transform( to_string ) );
 }
 
+// Same as above, but the vector and its strings come from a memory resource,
+// e.g. the scratch arena of a request, so the temporaries cost a pointer bump each
+auto split( std::string_view s, char delim, std::pmr::memory_resource* resource )
+{
+	auto parts = std::pmr::vector<std::pmr::string>{ resource };
+	for ( auto&& r : std::ranges::split_view{ s, delim } )
+	{
+		auto const citer = std::counted_iterator{ r.begin(), std::ssize( r ) };
+		auto const cv = std::ranges::common_view{ std::ranges::subrange{ citer, std::default_sentinel } };
+		parts.emplace_back( cv.begin(), cv.end() ); // The string gets the vector's resource
+	}
+	return parts;
+}
+
 void ViewsBefore()
 {
 	// generating views
@@ -106,6 +124,25 @@ void ViewsBefore()
 	const auto v2 = split( s, ',' );      // std::vector<std::string>
 	assert( v1 == v2 );                   // true
 
+	// Temporaries that die with the request can come from the thread's scratch arena,
+	// the frame releases all of them at once when it goes out of scope.
+	{
+		auto frame = ScratchFrame{};
+		const auto v3 = split( s, ',', frame.resource() ); // std::pmr::vector<std::pmr::string>
+		assert( std::ranges::equal( v2, v3, std::equal_to<std::string_view>{} ) );
+	}
+
+	const auto line = std::string{ "a fairly long first column,another long enough column,3.14159265358979,2024-01-01T00:00:00" };
+	run_benchmark( "split, std::allocator", [ & ]
+	{
+		DoNotOptimize( split( line, ',' ) );
+	} );
+	run_benchmark( "split, scratch arena", [ & ]
+	{
+		auto frame = ScratchFrame{};
+		DoNotOptimize( split( line, ',', frame.resource() ) );
+	} );
+
 	// span
 	//-------------------------------------------------------------------------
 
@@ -2,111 +2,290 @@
 // but those terms will be used to refer to abstractions from the standard library.
 
 #include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
 #include <memory>
+#include <string>
+#include <type_traits>
 #include <vector>
 #include <set>
 #include <array>
 #include <iostream>
 #include <memory_resource>
-
+#include <random>
+#include <thread>
+
+#include "Benchmark.h"
+#include "SlabAllocator.h"
+#include "SmallVector.h"
+#include "StatsResource.h"
+
+// An arena starts with N bytes of inline storage (e.g. on the stack). When they run out,
+// it chains blocks from an upstream memory resource, each one twice as big as the previous,
+// instead of falling back to the heap for every single request.
+// Freeing only reclaims the latest allocation, everything else is reclaimed at once by reset(),
+// which is O(1) and keeps the chained blocks around for reuse. release() returns them upstream.
+// Arena is also a std::pmr::memory_resource, so pmr containers can use it directly.
 template <size_t N>
-class Arena
+class Arena : public std::pmr::memory_resource
 {
     static constexpr size_t alignment = alignof( std::max_align_t );
 public:
-    Arena() noexcept : ptr_( buffer_ )
+    Arena() noexcept : Arena( std::pmr::get_default_resource() )
+    {}
+    explicit Arena( std::pmr::memory_resource* upstream ) noexcept
+        : ptr_( buffer_ ), begin_( buffer_ ), end_( buffer_ + N ), upstream_( upstream )
     {}
     Arena( const Arena& ) = delete;
     Arena& operator=( const Arena& ) = delete;
+    ~Arena()
+    {
+        release();
+    }
 
+    // Everything allocated so far becomes invalid
     auto reset() noexcept
     {
         ptr_ = buffer_;
+        begin_ = buffer_;
+        end_ = buffer_ + N;
+        current_ = nullptr;
+        used_in_previous_blocks_ = 0;
+    }
+    // Like reset(), and also gives the chained blocks back to the upstream resource
+    auto release() noexcept
+    {
+        reset();
+        while ( first_ != nullptr )
+        {
+            auto* next = first_->next_;
+            upstream_->deallocate( first_, sizeof( Block ) + first_->size_, alignment );
+            first_ = next;
+        }
+        capacity_ = N;
+        block_count_ = 0;
     }
     static constexpr auto size() noexcept
     {
         return N;
     }
+    // Bytes handed out since the last reset, including padding and the unused ends of full blocks
     auto used() const noexcept
     {
-        return static_cast<size_t>( ptr_ - buffer_ );
+        return used_in_previous_blocks_ + static_cast<size_t>( ptr_ - begin_ );
+    }
+    // Bytes owned by the arena, inline storage included
+    auto capacity() const noexcept
+    {
+        return capacity_;
+    }
+    auto high_water_mark() const noexcept
+    {
+        return high_water_mark_;
     }
-    auto allocate( size_t n ) -> std::byte*;
-    auto deallocate( std::byte* p, size_t n ) noexcept -> void;
+    auto block_count() const noexcept
+    {
+        return block_count_;
+    }
+    // The raw bump allocation behind both ShortAlloc and the memory_resource interface
+    // (named apart, so they don't hide memory_resource::allocate/deallocate)
+    auto bump( size_t n, size_t align = alignment ) -> std::byte*;
+    auto unbump( std::byte* p, size_t n ) noexcept -> void;
 
 private:
-    static auto align_up( size_t n ) noexcept -> size_t
+    // Header of every upstream block, the usable bytes follow it
+    struct alignas( alignment ) Block
+    {
+        Block* next_{};
+        size_t size_{};
+        auto data() noexcept
+        {
+            return reinterpret_cast<std::byte*>( this + 1 );
+        }
+    };
+
+    static auto align_up( size_t n, size_t align = alignment ) noexcept -> size_t
+    {
+        return ( n + ( align - 1 ) ) & ~( align - 1 );
+    }
+    auto next_block( size_t n, size_t align ) -> void;
+
+    auto do_allocate( size_t bytes, size_t align ) -> void* override
+    {
+        return bump( bytes, align );
+    }
+    auto do_deallocate( void* p, size_t bytes, size_t ) -> void override
     {
-        return ( n + ( alignment - 1 ) ) & ~( alignment - 1 );
+        unbump( static_cast<std::byte*>( p ), bytes );
     }
-    auto pointer_in_buffer( const std::byte* p ) const noexcept -> bool
+    auto do_is_equal( const std::pmr::memory_resource& other ) const noexcept -> bool override
     {
-        return std::uintptr_t( p ) >= std::uintptr_t( buffer_ ) &&
-            std::uintptr_t( p ) < std::uintptr_t( buffer_ ) + N;
+        return this == &other;
     }
+
     alignas( alignment ) std::byte buffer_[N];
     std::byte* ptr_{};
+    std::byte* begin_{}; // Of the current block
+    std::byte* end_{};
+    Block* current_{ nullptr }; // nullptr while in the inline buffer
+    Block* first_{ nullptr };
+    std::pmr::memory_resource* upstream_{};
+    size_t next_block_size_{ std::max<size_t>( N, 256 ) * 2 };
+    size_t used_in_previous_blocks_{ 0 };
+    size_t capacity_{ N };
+    size_t high_water_mark_{ 0 };
+    size_t block_count_{ 0 };
 };
 
 template<size_t N>
-auto Arena<N>::allocate( size_t n ) -> std::byte*
+auto Arena<N>::bump( size_t n, size_t align ) -> std::byte*
 {
     const auto aligned_n = align_up( n );
-    const auto available_bytes = static_cast<decltype( aligned_n )>( buffer_ + N - ptr_ );
-    if ( available_bytes >= aligned_n )
+    auto* p = reinterpret_cast<std::byte*>( align_up( reinterpret_cast<std::uintptr_t>( ptr_ ), align ) );
+    if ( p > end_ || static_cast<size_t>( end_ - p ) < aligned_n )
     {
-        auto* r = ptr_;
-        ptr_ += aligned_n;
-        return r;
+        next_block( aligned_n, align );
+        p = reinterpret_cast<std::byte*>( align_up( reinterpret_cast<std::uintptr_t>( ptr_ ), align ) );
     }
-    return static_cast<std::byte*>( ::operator new( n ) );
+    ptr_ = p + aligned_n;
+    high_water_mark_ = std::max( high_water_mark_, used() );
+    return p;
 }
 
 template<size_t N>
-auto Arena<N>::deallocate( std::byte* p, size_t n ) noexcept -> void
+auto Arena<N>::next_block( size_t n, size_t align ) -> void
 {
-    if ( pointer_in_buffer( p ) )
+    const auto needed = n + ( align > alignment ? align : 0 );
+    used_in_previous_blocks_ += static_cast<size_t>( end_ - begin_ );
+
+    // Reuse the blocks kept by reset() first
+    auto* next = current_ != nullptr ? current_->next_ : first_;
+    if ( next == nullptr || next->size_ < needed )
     {
-        n = align_up( n );
-        if ( p + n == ptr_ )
-        {
-            ptr_ = p;
-        }
+        const auto size = std::max( next_block_size_, align_up( needed ) );
+        next = ::new ( upstream_->allocate( sizeof( Block ) + size, alignment ) ) Block{ next, size };
+        ( current_ != nullptr ? current_->next_ : first_ ) = next;
+        next_block_size_ = size * 2;
+        capacity_ += size;
+        ++block_count_;
     }
-    else
+    current_ = next;
+    ptr_ = begin_ = next->data();
+    end_ = begin_ + next->size_;
+}
+
+template<size_t N>
+auto Arena<N>::unbump( std::byte* p, size_t n ) noexcept -> void
+{
+    // Only the latest allocation can be given back, the rest waits for reset()
+    n = align_up( n );
+    if ( p >= begin_ && p + n == ptr_ )
     {
-        ::operator delete( p );
+        ptr_ = p;
     }
 }
 
-auto user_arena = Arena<1024>{};
+// Class-level operator new/delete used to bump out of a global Arena<1024>, which only reclaims
+// the last allocation: users destroyed in any other order leaked arena space until it spilled to the heap.
+// The slab pool takes them back in any order (see SlabAllocator.h), arrays use the global operator new[].
+class CUser : public PoolAllocated<CUser>
+{
+private:
+    int id_{};
+};
 
-class CUser
+// Same size as CUser, allocated with std::allocator
+struct PlainUser
 {
-public:
+    int id_{};
+};
 
-    auto operator new( size_t size ) -> void*
+namespace
+{
+    // Randomly creates or destroys objects in a set of slots, so the frees come in no particular order
+    template <class Create, class Destroy>
+    auto random_churn( size_t slot_count, size_t operations, unsigned seed, Create create, Destroy destroy )
     {
-        return user_arena.allocate( size );
+        auto slots = std::vector<void*>( slot_count );
+        auto engine = std::minstd_rand{ seed };
+        for ( auto i = size_t{ 0 }; i < operations; ++i )
+        {
+            auto& slot = slots[engine() % slot_count];
+            if ( slot == nullptr )
+            {
+                slot = create();
+            }
+            else
+            {
+                destroy( slot );
+                slot = nullptr;
+            }
+        }
+        for ( auto* slot : slots )
+        {
+            if ( slot != nullptr )
+            {
+                destroy( slot );
+            }
+        }
     }
 
-    auto operator delete( void* p ) -> void
+    auto pool_create() -> void*
     {
-        user_arena.deallocate( static_cast<std::byte*>( p ), sizeof( CUser ) );
+        return new CUser{};
     }
-
-    auto operator new[] ( size_t size ) -> void*
+    auto pool_destroy( void* p ) -> void
     {
-        return user_arena.allocate( size );
+        delete static_cast<CUser*>( p );
+    }
+    auto std_create() -> void*
+    {
+        auto alloc = std::allocator<PlainUser>{};
+        auto* p = alloc.allocate( 1 );
+        return std::construct_at( p );
+    }
+    auto std_destroy( void* p ) -> void
+    {
+        auto alloc = std::allocator<PlainUser>{};
+        std::destroy_at( static_cast<PlainUser*>( p ) );
+        alloc.deallocate( static_cast<PlainUser*>( p ), 1 );
     }
 
-    auto operator delete[] ( void* p, size_t size ) -> void
+    auto slab_benchmarks() -> void
     {
-        user_arena.deallocate( static_cast<std::byte*>( p ), size );
+        constexpr auto kSlots = size_t{ 4096 };
+        constexpr auto kOperations = size_t{ 1 } << 14;
+        run_benchmark( "random churn, std::allocator", [ & ]
+        {
+            random_churn( kSlots, kOperations, 42, std_create, std_destroy );
+        } );
+        run_benchmark( "random churn, slab pool", [ & ]
+        {
+            random_churn( kSlots, kOperations, 42, pool_create, pool_destroy );
+        } );
+
+        // Every thread churns on its own, the pool only synchronizes when a batch moves to or from the depot
+        const auto threads = BenchmarkContext::threads();
+        const auto parallel_churn = [ & ] ( auto create, auto destroy )
+        {
+            auto workers = std::vector<std::jthread>{};
+            for ( auto t = size_t{ 0 }; t < threads; ++t )
+            {
+                workers.emplace_back( [ = ] { random_churn( kSlots, kOperations, static_cast<unsigned>( t + 1 ), create, destroy ); } );
+            }
+        };
+        run_benchmark( std::to_string( threads ) + " thread(s) churn, std::allocator", [ & ]
+        {
+            parallel_churn( std_create, std_destroy );
+        } );
+        run_benchmark( std::to_string( threads ) + " thread(s) churn, slab pool", [ & ]
+        {
+            parallel_churn( pool_create, pool_destroy );
+        } );
+        std::cout << "slab pool reserved: " << ObjectPool<CUser>::reserved() << " bytes\n";
     }
-private:
-    int id_{};
-};
+}
 
 // A stateless memory allocator
 template <class T>
@@ -161,6 +340,13 @@ struct ShortAlloc
     using value_type = T;
     using arena_type = Arena<N>;
 
+    // Containers with different arenas are not interchangeable.
+    // A copy keeps its own arena, a move or a swap takes the arena along with the memory, so they stay O(1).
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
     ShortAlloc( const ShortAlloc& ) = default;
     ShortAlloc& operator=( const ShortAlloc& ) = default;
 
@@ -180,11 +366,15 @@ struct ShortAlloc
 
     auto allocate( size_t n ) -> T*
     {
-        return reinterpret_cast<T*>( arena_->allocate( n * sizeof( T ) ) );
+        if ( n > std::numeric_limits<size_t>::max() / sizeof( T ) )
+        {
+            throw std::bad_array_new_length{};
+        }
+        return reinterpret_cast<T*>( arena_->bump( n * sizeof( T ), alignof( T ) ) );
     }
     auto deallocate( T* p, size_t n ) noexcept -> void
     {
-        arena_->deallocate( reinterpret_cast<std::byte*>( p ), n * sizeof( T ) );
+        arena_->unbump( reinterpret_cast<std::byte*>( p ), n * sizeof( T ) );
     }
     template <class U, size_t M>
     auto operator==( const ShortAlloc<U, M>& other ) const noexcept
@@ -196,45 +386,32 @@ struct ShortAlloc
     {
         return !( *this == other );
     }
+    // A copied container shares the arena of the original
+    auto select_on_container_copy_construction() const noexcept -> ShortAlloc
+    {
+        return *this;
+    }
+    auto arena() const noexcept -> arena_type&
+    {
+        return *arena_;
+    }
     template <class U, size_t M> friend struct ShortAlloc;
 private:
     arena_type* arena_;
 };
 
 template <typename T>
-using SmallVector = std::vector<T, ShortAlloc<T, 512>>;
+using ShortVector = std::vector<T, ShortAlloc<T, 512>>;
 
 template <typename T>
 using AscendingSmallSet = std::set<T, std::less<T>, ShortAlloc<T, 512>>;
 template <typename T>
 using DescendingSmallSet = std::set<T, std::greater<T>, ShortAlloc<T, 512>>;
 
-class PrintingResource : public std::pmr::memory_resource
-{
-public:
-    PrintingResource() : res_{ std::pmr::get_default_resource() }
-    {}
-private:
-    virtual void* do_allocate( std::size_t bytes, std::size_t alignment ) override
-    {
-        std::cout << "allocate: " << bytes << '\n';
-        return res_->allocate( bytes, alignment );
-    }
-    virtual void do_deallocate( void* p, std::size_t bytes, std::size_t alignment ) override
-    {
-        std::cout << "deallocate: " << bytes << '\n';
-        return res_->deallocate( p, bytes, alignment );
-    }
-    virtual bool do_is_equal( const std::pmr::memory_resource& other ) const noexcept override
-    {
-        return ( this == &other );
-    }
-    std::pmr::memory_resource* res_;  // Default resource
-};
-
 void CustomAllocator()
 {
-    // No dynamic memory is allocated when we create the users 
+    // The users come from the slab pool of CUser's size class,
+    // only the first one takes memory (a whole slab) from the heap
     auto user1 = new CUser{};
     delete user1;
 
@@ -243,7 +420,7 @@ void CustomAllocator()
 
     auto user2 = std::make_unique<CUser>();
 
-    // we can _NOT_ use our custom memory allocator, since shared_ptr need more memory to store a CUser
+    // we can _NOT_ use our custom memory allocator, since shared_ptr need more memory to store a CUser (see allocate_shared below)
     auto user = std::make_shared<CUser>();
 
     // Ditto
@@ -252,14 +429,46 @@ void CustomAllocator()
 
     // Instead, we use our own allocator
     // No dynamic memory allocation!
-    auto stack_arena = SmallVector<CUser>::allocator_type::arena_type{};
-    auto cusers = SmallVector<CUser>{ stack_arena };
+    auto stack_arena = ShortVector<CUser>::allocator_type::arena_type{};
+    auto cusers = ShortVector<CUser>{ stack_arena };
     cusers.reserve( 10 );
 
+    // ShortAlloc is a complete allocator (rebind, propagation traits, alignment), so shared ownership
+    // can come from the stack arena too: the control block and the CUser are a single arena allocation
+    auto shared_user = std::allocate_shared<CUser>( ShortAlloc<CUser, 512>{ stack_arena } );
+
+    // And Arena is a std::pmr::memory_resource, so every pmr container can share it
+    auto ids = std::pmr::vector<int>( { 1, 2, 3 }, &stack_arena );
+    auto names = std::pmr::set<std::pmr::string>{ &stack_arena };
+    names.emplace( "a name too long for the small string buffer" );
+    std::cout << "stack arena used: " << stack_arena.used() << ", blocks taken from the heap: " << stack_arena.block_count() << '\n';
+
     std::cout << sizeof( std::vector<int> ) << '\n';
     // Possible output: 32
-    std::cout << sizeof( SmallVector<int> ) << '\n';
+    std::cout << sizeof( ShortVector<int> ) << '\n';
     // Possible output: 40
+    // No arena to declare next to it, the first 8 ints live in the vector itself (see SmallVector.h)
+    std::cout << sizeof( SmallVector<int, 8> ) << '\n';
+    // Possible output: 56
+
+    // The arena chains bigger and bigger blocks once its inline buffer is full,
+    // and reset() makes all of them available again in O(1)
+    {
+        auto arena = Arena<512>{};
+        {
+            auto numbers = AscendingSmallSet<int>{ arena };
+            for ( auto i = 0; i < 1000; ++i )
+            {
+                numbers.insert( i );
+            }
+        }
+        std::cout << "used: " << arena.used() << ", capacity: " << arena.capacity()
+                  << ", blocks: " << arena.block_count() << ", high water mark: " << arena.high_water_mark() << '\n';
+        arena.reset();
+        std::cout << "after reset, used: " << arena.used() << ", capacity: " << arena.capacity() << '\n';
+    }
+
+    slab_benchmarks();
 
     std::cout << "\n//-------------------------------------------------------------------------\n\n";
 
@@ -296,8 +505,20 @@ void CustomAllocator()
         std::cout << number << '\n';
     }
 
-    auto res = PrintingResource{};
+    // Instead of printing every allocation, count them (see StatsResource.h) and dump the profile when needed
+    auto res = StatsResource{ "CustomAllocator vec" };
     auto vec = std::pmr::vector<int>{ &res };
     vec.emplace_back( 1 );
     vec.emplace_back( 2 );
+
+    // Resources chain, so one can watch a pool and another what the pool takes from upstream
+    auto upstream_stats = StatsResource{ "CustomAllocator pool upstream" };
+    auto pool = std::pmr::unsynchronized_pool_resource{ &upstream_stats };
+    auto pool_stats = StatsResource{ "CustomAllocator pool", &pool };
+    auto strings = std::pmr::vector<std::pmr::string>{ &pool_stats };
+    for ( auto i = 0; i < 100; ++i )
+    {
+        strings.emplace_back( "a string long enough to need its own allocation" );
+    }
+    StatsResource::print_all( std::cout );
 }
\ No newline at end of file
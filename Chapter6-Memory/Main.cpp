@@ -28,10 +28,12 @@ void CustomAllocator();
 // back to the flash storage of the mobile devices is that it drains the battery,
 // and it also shortens the lifespan of the flash storage itself.
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( MemoryUsage );
 	Entry( MemoryOwnership );
 	Entry( SmallObjectOptimization );
 	Entry( CustomAllocator );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
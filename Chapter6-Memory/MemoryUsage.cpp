@@ -1,7 +1,15 @@
 #include <memory>
+#include <string>
+#include <vector>
 #include <iostream>
 #include <cassert>
 #include <stdlib.h>
+#include <bit>
+#include <limits>
+
+#include "AllocationTracker.h"
+#include "SlabAllocator.h"
+#include "AlignedAllocator.h"
 
 // The CPU reads memory into its registers one word at a time.
 // The word size is 64 bits on a 64 - bit architecture, 32 bits on a 32 - bit architecture.
@@ -14,16 +22,18 @@ struct User
 	bool				m_hasPassword{};
 
 	// class specified overload new and delete
+	// Users are fixed-size, so they come from a slab pool instead of the general purpose heap.
+	// (Inheriting PoolAllocated<User> would do the same, but User would no longer be a plain aggregate.)
 	//-------------------------------------------------------------------------
 	auto operator new( size_t size ) -> void*
 	{
 		std::cout << "Allocate happen for User class!\n";
-		return ::operator new( size );
+		return PoolAllocated<User>::operator new( size );
 	}
-	auto operator delete( void* p ) -> void
+	auto operator delete( void* p, size_t size ) -> void
 	{
 		std::cout << "Deallocate happen for User class!\n";
-		::operator delete( p );
+		PoolAllocated<User>::operator delete( p, size );
 	}
 };
 
@@ -31,44 +41,49 @@ struct User
 // Global overload new and delete
 //-------------------------------------------------------------------------
 
-auto operator new( size_t size ) -> void*
+// Printing from here would allocate and lock inside every allocation,
+// so the replacements only record into the AllocationTracker and we print a report on demand.
+// The aligned versions use a portable header scheme instead of _aligned_malloc (Windows only).
+
+HP_NOINLINE auto operator new( size_t size ) -> void*
 {
-	void* p = std::malloc( size );
-	std::cout << "allocated " << size << " byte(s)\n";
-	return p;
+	return AllocationTracker::allocate_or_throw( size, __STDCPP_DEFAULT_NEW_ALIGNMENT__, HP_RETURN_ADDRESS() );
 }
 
 // C++17 alignment version
-void* operator new( std::size_t size, std::align_val_t al )
+HP_NOINLINE void* operator new( std::size_t size, std::align_val_t al )
 {
-	void* p = _aligned_malloc( size, static_cast<size_t>( al ) );
-	std::cout << "alignment allocated " << size << " byte(s)\n";
-	return p;
+	return AllocationTracker::allocate_or_throw( size, static_cast<size_t>( al ), HP_RETURN_ADDRESS() );
 }
 
 auto operator delete( void* p ) noexcept -> void
 {
-	std::cout << "deleted memory\n";
-	return std::free( p );
+	AllocationTracker::deallocate( p );
+}
+
+void operator delete  ( void* ptr, std::align_val_t ) noexcept
+{
+	AllocationTracker::deallocate( ptr );
 }
 
-void operator delete  ( void* ptr, std::align_val_t al ) noexcept
+HP_NOINLINE auto operator new[] ( size_t size ) -> void*
 {
-	std::cout << "alignment deleted memory\n";
-	return _aligned_free( ptr );
+	return AllocationTracker::allocate_or_throw( size, __STDCPP_DEFAULT_NEW_ALIGNMENT__, HP_RETURN_ADDRESS() );
 }
 
-auto operator new[] ( size_t size ) -> void*
+HP_NOINLINE void* operator new[] ( std::size_t size, std::align_val_t al )
 {
-	void* p = std::malloc( size );
-	std::cout << "allocated " << size << " byte(s) with new[]\n";
-	return p;
+	return AllocationTracker::allocate_or_throw( size, static_cast<size_t>( al ), HP_RETURN_ADDRESS() );
 }
 
 auto operator delete[] ( void* p ) noexcept -> void
 {
-	std::cout << "deleted memory with delete[]\n";
-	return std::free( p );
+	AllocationTracker::deallocate( p );
+}
+
+void operator delete[] ( void* ptr, std::align_val_t ) noexcept
+{
+	AllocationTracker::deallocate( ptr );
 }
 
 //-------------------------------------------------------------------------
@@ -172,5 +187,35 @@ void MemoryUsage()
 	// Use page ...
 	delete page;
 
+	// alignas only applies to types, containers get their alignment from the allocator
+	auto floats = std::vector<float, AlignedAllocator<float>>( 100 );
+	assert( is_aligned( floats.data(), cache_line_size ) );
+	auto pages = std::vector<Page, AlignedAllocator<Page>>( 2 ); // Over-aligned types keep their own alignment
+	assert( is_aligned( pages.data(), ps ) );
+
+	auto buffer = AlignedBuffer<float>( 100, Padding::WholeCacheLines );
+	assert( is_aligned( buffer.data(), cache_line_size ) );
+	std::cout << buffer.size() << " floats, " << buffer.padded_size() << " allocated\n";
+	// Output: 100 floats, 112 allocated
+
+	// Each counter on its own cache line, threads incrementing their own counter don't false-share
+	auto counters = std::vector<CacheLinePadded<int>>( 4 );
+	std::cout << sizeof( counters[0] ) << '\n';
+	// Output: 64
+
+	std::cout << "\n";
+
+	// Report of every allocation made so far through the global operator new
+	//-------------------------------------------------------------------------
+
+	AllocationTracker::set_capture_stacks( true );
+	{
+		auto strings = std::vector<std::string>{};
+		for ( auto i = 0; i < 1000; ++i )
+		{
+			strings.push_back( std::to_string( i ) + " is a number too long for small string optimization" );
+		}
+	}
+	AllocationTracker::report( std::cout );
 	std::cout << "\n";
 }
\ No newline at end of file
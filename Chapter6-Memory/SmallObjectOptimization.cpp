@@ -2,6 +2,8 @@
 #include <string>
 #include <iostream>
 
+#include "SmallVector.h"
+
 // Note: It is usually harm to allocate small object using heap, try to use stack to store this objects.
 
 //auto allocated = size_t{ 0 };
@@ -22,6 +24,10 @@ void SmallObjectOptimization()
 {
 	auto smallVec = std::vector{ 2, 3 }; // bad
 	int smallArray[] = { 2, 3, 0, 0 }; // good
+	auto smallVec2 = SmallVector<int, 4>{ 2, 3 }; // good, and can still grow past 4 (then it goes to the heap)
+
+	std::cout << sizeof( smallVec ) << ' ' << sizeof( smallVec2 ) << ( smallVec2.is_inline() ? " inline\n" : " on the heap\n" );
+	// Possible output: 24 40 inline
 
 	auto shortStr = std::string{ "" };
 
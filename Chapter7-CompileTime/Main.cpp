@@ -18,11 +18,13 @@ void ConstraintAndConcept();
 void DependentTemplateArgument();
 void Cpp20NTTP();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( TypeTemplate );
 	Entry( TypeTraits );
 	Entry( ConstraintAndConcept );
 	Entry( DependentTemplateArgument );
 	Entry( Cpp20NTTP );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
@@ -7,8 +7,10 @@
 void Optional();
 void Heterogenous();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( Optional );
 	Entry( Heterogenous );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
@@ -8,9 +8,11 @@ void LazyAndEager();
 void PostpondComputation();
 void ExpressionTemplate();
 
-int main()
+int main( int argc, char** argv )
 {
 	Entry( LazyAndEager );
 	Entry( PostpondComputation );
 	Entry( ExpressionTemplate );
+
+	return EntryRunner::instance().run( argc, argv );
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <span>
+#include <utility>
+
+// Storage that starts on a cache line (or page) boundary.
+//
+// alignas( 64 ) only applies to the type. std::vector<float> gets alignof( std::max_align_t ), usually 16 bytes,
+// so a vector loop over it starts with a partial vector (or does unaligned loads). Two threads writing to
+// neighbouring per-thread data also share a cache line without it, and that line bounces between their cores
+// on every write (false sharing).
+//
+// - AlignedAllocator<T, Align> is a standard allocator on top of the aligned operator new (C++17),
+//   so it works with every container and with replaced operator new / delete.
+// - AlignedBuffer<T, Align> is a fixed size array on it. With Padding::WholeCacheLines its allocation
+//   is rounded up to whole Align blocks, so nothing else lives on its last line and a kernel can load
+//   full vectors up to the end of the padding.
+// - CacheLinePadded<T> gives each element of an array its own cache line.
+//
+//     auto values = std::vector<float, AlignedAllocator<float>>( n );  // values.data() is 64 byte aligned
+//     auto counters = std::vector<CacheLinePadded<int>>( n_threads );  // One line per thread
+
+// Not std::hardware_destructive_interference_size: its value may differ between compilers and flags,
+// which GCC warns about when it is used in a header. 64 bytes is right for x86-64 and most ARM cores.
+inline constexpr size_t cache_line_size = 64;
+
+template <class T, size_t Align = cache_line_size>
+struct AlignedAllocator
+{
+    static_assert( std::has_single_bit( Align ), "Alignment must be a power of two" );
+
+    using value_type = T;
+    static constexpr size_t alignment = std::max( Align, alignof( T ) );
+
+    // Needed since Align is not a type parameter, allocator_traits can't rebind it by itself
+    template <class U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Align>;
+    };
+
+    AlignedAllocator() noexcept = default;
+    template <class U>
+    AlignedAllocator( const AlignedAllocator<U, Align>& ) noexcept
+    {}
+
+    auto allocate( size_t n ) -> T*
+    {
+        if ( n > std::numeric_limits<size_t>::max() / sizeof( T ) )
+        {
+            throw std::bad_array_new_length{};
+        }
+        return static_cast<T*>( ::operator new( n * sizeof( T ), std::align_val_t{ alignment } ) );
+    }
+    auto deallocate( T* p, size_t n ) noexcept -> void
+    {
+        ::operator delete( p, n * sizeof( T ), std::align_val_t{ alignment } );
+    }
+
+    template <class U>
+    auto operator==( const AlignedAllocator<U, Align>& ) const noexcept
+    {
+        return true;
+    }
+};
+
+enum class Padding
+{
+    None,
+    WholeCacheLines // Rounded up to a multiple of Align bytes
+};
+
+// A heap array of n value-initialized elements that starts on an Align boundary.
+// It doesn't grow; its padding elements are value-initialized too, but are not part of size() or begin() / end().
+template <class T, size_t Align = cache_line_size>
+class AlignedBuffer
+{
+    using Allocator = AlignedAllocator<T, Align>;
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    static constexpr size_t alignment = Allocator::alignment;
+
+    AlignedBuffer() noexcept = default;
+    explicit AlignedBuffer( size_t n, Padding padding = Padding::None )
+        : size_{ n }, capacity_{ padding == Padding::WholeCacheLines ? padded( n ) : n }
+    {
+        if ( capacity_ == 0 )
+        {
+            return;
+        }
+        data_ = Allocator{}.allocate( capacity_ );
+        try
+        {
+            std::uninitialized_value_construct_n( data_, capacity_ );
+        }
+        catch ( ... )
+        {
+            Allocator{}.deallocate( data_, capacity_ );
+            throw;
+        }
+    }
+    AlignedBuffer( AlignedBuffer&& other ) noexcept
+        : data_{ std::exchange( other.data_, nullptr ) }, size_{ std::exchange( other.size_, 0 ) },
+          capacity_{ std::exchange( other.capacity_, 0 ) }
+    {}
+    auto operator=( AlignedBuffer&& other ) noexcept -> AlignedBuffer&
+    {
+        auto tmp = std::move( other );
+        std::swap( data_, tmp.data_ );
+        std::swap( size_, tmp.size_ );
+        std::swap( capacity_, tmp.capacity_ );
+        return *this;
+    }
+    ~AlignedBuffer()
+    {
+        if ( data_ != nullptr )
+        {
+            std::destroy_n( data_, capacity_ );
+            Allocator{}.deallocate( data_, capacity_ );
+        }
+    }
+
+    auto operator[]( size_t i ) noexcept -> T&
+    {
+        return data_[i];
+    }
+    auto operator[]( size_t i ) const noexcept -> const T&
+    {
+        return data_[i];
+    }
+    auto data() noexcept -> T*
+    {
+        return data_;
+    }
+    auto data() const noexcept -> const T*
+    {
+        return data_;
+    }
+    auto size() const noexcept -> size_t
+    {
+        return size_;
+    }
+    auto empty() const noexcept -> bool
+    {
+        return size_ == 0;
+    }
+    // Elements allocated, size() plus the padding
+    auto padded_size() const noexcept -> size_t
+    {
+        return capacity_;
+    }
+
+    auto begin() noexcept -> iterator
+    {
+        return data_;
+    }
+    auto begin() const noexcept -> const_iterator
+    {
+        return data_;
+    }
+    auto end() noexcept -> iterator
+    {
+        return data_ + size_;
+    }
+    auto end() const noexcept -> const_iterator
+    {
+        return data_ + size_;
+    }
+
+    auto span() noexcept -> std::span<T>
+    {
+        return { data_, size_ };
+    }
+    auto span() const noexcept -> std::span<const T>
+    {
+        return { data_, size_ };
+    }
+
+private:
+    // Whole elements ending on an Align boundary: a multiple of lcm( Align, sizeof( T ) ) bytes
+    // (3 lines for 8 elements of 24 bytes)
+    static auto padded( size_t n ) -> size_t
+    {
+        constexpr auto per_block = std::lcm( alignment, sizeof( T ) ) / sizeof( T );
+        if ( n > std::numeric_limits<size_t>::max() / sizeof( T ) - per_block )
+        {
+            throw std::bad_array_new_length{};
+        }
+        return ( n + per_block - 1 ) / per_block * per_block;
+    }
+
+    T* data_{ nullptr };
+    size_t size_{ 0 };
+    size_t capacity_{ 0 };
+};
+
+// A T alone on its cache line, for arrays of per-thread data
+template <class T>
+struct alignas( cache_line_size ) CacheLinePadded
+{
+    T value_{};
+};
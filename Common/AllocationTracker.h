@@ -0,0 +1,381 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <numeric>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef NOMINMAX
+#undef WIN32_LEAN_AND_MEAN
+#define HP_RETURN_ADDRESS() _ReturnAddress()
+#define HP_NOINLINE __declspec( noinline )
+#else
+#include <execinfo.h>
+#define HP_RETURN_ADDRESS() __builtin_return_address( 0 )
+#define HP_NOINLINE __attribute__( ( noinline ) )
+#endif
+
+// Allocation tracking layer for replaced global operator new/delete.
+//
+// Printing from operator new (like MemoryUsage.cpp used to) changes the program it measures:
+// the output itself allocates, takes a lock and makes the hot path I/O bound.
+// Instead every allocation only bumps a few relaxed atomics:
+//
+// - count/bytes per power-of-two size class, in a per-thread slot (no sharing between threads)
+// - count/bytes per call site (the return address of operator new) in a fixed lock-free hash table,
+//   optionally with the full stack captured the first time a call site is seen
+// - live bytes and peak live bytes
+//
+// Nothing is allocated by the tracker itself, so it can't recurse into operator new.
+// Call report() on demand, or report_at_exit() once.
+//
+// Usage, in exactly one translation unit (HP_NOINLINE keeps the return address pointing at the caller):
+//
+//   HP_NOINLINE auto operator new( size_t size ) -> void*
+//   {
+//       return AllocationTracker::allocate_or_throw( size, alignof( std::max_align_t ), HP_RETURN_ADDRESS() );
+//   }
+//   auto operator delete( void* p ) noexcept -> void
+//   {
+//       AllocationTracker::deallocate( p );
+//   }
+
+class AllocationTracker
+{
+public:
+    static constexpr size_t num_size_classes = 18;  // <= 16 B, <= 32 B, ..., <= 1 MiB, larger
+    static constexpr size_t max_threads = 256;      // Later threads share the last slot
+    static constexpr size_t max_call_sites = 4096;
+    static constexpr size_t max_stack_depth = 12;
+
+    // Allocates size bytes aligned to alignment and records it. Returns nullptr on failure.
+    static auto allocate( size_t size, size_t alignment, void* call_site ) noexcept -> void*
+    {
+        alignment = std::max( alignment, alignof( Header ) );
+        // [raw ... padding][Header][user memory], the header sits right before the user pointer
+        auto* raw = static_cast<std::byte*>( std::malloc( size + alignment + sizeof( Header ) ) );
+        if ( raw == nullptr )
+        {
+            return nullptr;
+        }
+        const auto user_addr = ( reinterpret_cast<std::uintptr_t>( raw ) + sizeof( Header ) + alignment - 1 ) & ~( alignment - 1 );
+        auto* user = reinterpret_cast<std::byte*>( user_addr );
+        auto* header = reinterpret_cast<Header*>( user ) - 1;
+        header->raw_ = raw;
+        header->size_ = size;
+
+        record_allocation( size, call_site );
+        return user;
+    }
+
+    static auto allocate_or_throw( size_t size, size_t alignment, void* call_site ) -> void*
+    {
+        if ( auto* p = allocate( size, alignment, call_site ) )
+        {
+            return p;
+        }
+        throw std::bad_alloc{};
+    }
+
+    static auto deallocate( void* p ) noexcept -> void
+    {
+        if ( p == nullptr )
+        {
+            return;
+        }
+        auto* header = static_cast<Header*>( p ) - 1;
+        record_deallocation( header->size_ );
+        std::free( header->raw_ );
+    }
+
+    // Capturing a stack is expensive, but only happens the first time a call site is seen
+    static auto set_capture_stacks( bool enabled ) noexcept -> void
+    {
+        state().capture_stacks_.store( enabled, std::memory_order_relaxed );
+    }
+
+    static auto live_bytes() noexcept -> std::int64_t
+    {
+        return state().live_bytes_.load( std::memory_order_relaxed );
+    }
+    static auto peak_live_bytes() noexcept -> std::int64_t
+    {
+        return state().peak_live_bytes_.load( std::memory_order_relaxed );
+    }
+
+    static auto report( std::ostream& os, size_t top_call_sites = 10 ) -> void
+    {
+        auto& s = state();
+        auto guard = ReentrancyGuard{};
+
+        // Merge the per-thread slots
+        auto counts = std::array<std::uint64_t, num_size_classes>{};
+        auto bytes = std::array<std::uint64_t, num_size_classes>{};
+        auto frees = std::uint64_t{ 0 };
+        const auto n_slots = std::min( s.next_slot_.load(), max_threads );
+        for ( auto t = size_t{ 0 }; t < n_slots; ++t )
+        {
+            const auto& slot = s.threads_[t];
+            for ( auto c = size_t{ 0 }; c < num_size_classes; ++c )
+            {
+                counts[c] += slot.counts_[c].load( std::memory_order_relaxed );
+                bytes[c] += slot.bytes_[c].load( std::memory_order_relaxed );
+            }
+            frees += slot.frees_.load( std::memory_order_relaxed );
+        }
+
+        char line[160];
+        const auto total_count = std::accumulate( counts.begin(), counts.end(), std::uint64_t{ 0 } );
+        const auto total_bytes = std::accumulate( bytes.begin(), bytes.end(), std::uint64_t{ 0 } );
+        std::snprintf( line, sizeof( line ), "allocations: %llu (%llu bytes), deallocations: %llu, live: %lld bytes, peak live: %lld bytes\n",
+                       static_cast<unsigned long long>( total_count ), static_cast<unsigned long long>( total_bytes ),
+                       static_cast<unsigned long long>( frees ),
+                       static_cast<long long>( live_bytes() ), static_cast<long long>( peak_live_bytes() ) );
+        os << line;
+
+        os << "  size class        count          bytes\n";
+        for ( auto c = size_t{ 0 }; c < num_size_classes; ++c )
+        {
+            if ( counts[c] == 0 )
+            {
+                continue;
+            }
+            if ( c + 1 < num_size_classes )
+                std::snprintf( line, sizeof( line ), "  <= %-10zu %10llu %14llu\n", size_t{ 16 } << c,
+                               static_cast<unsigned long long>( counts[c] ), static_cast<unsigned long long>( bytes[c] ) );
+            else
+                std::snprintf( line, sizeof( line ), "  >  %-10zu %10llu %14llu\n", size_t{ 16 } << ( c - 1 ),
+                               static_cast<unsigned long long>( counts[c] ), static_cast<unsigned long long>( bytes[c] ) );
+            os << line;
+        }
+
+        // Top call sites by bytes
+        auto sites = std::array<const CallSite*, max_call_sites>{};
+        auto n_sites = size_t{ 0 };
+        for ( const auto& site : s.call_sites_ )
+        {
+            if ( site.ready_.load( std::memory_order_acquire ) )
+            {
+                sites[n_sites++] = &site;
+            }
+        }
+        const auto n_top = std::min( top_call_sites, n_sites );
+        std::partial_sort( sites.begin(), sites.begin() + n_top, sites.begin() + n_sites,
+                           [] ( const CallSite* a, const CallSite* b )
+        {
+            return a->bytes_.load( std::memory_order_relaxed ) > b->bytes_.load( std::memory_order_relaxed );
+        } );
+
+        os << "  top call sites by bytes:\n";
+        for ( auto i = size_t{ 0 }; i < n_top; ++i )
+        {
+            const auto* site = sites[i];
+            std::snprintf( line, sizeof( line ), "  %10llu allocs %14llu bytes  at ",
+                           static_cast<unsigned long long>( site->count_.load( std::memory_order_relaxed ) ),
+                           static_cast<unsigned long long>( site->bytes_.load( std::memory_order_relaxed ) ) );
+            os << line;
+            print_address( os, reinterpret_cast<void*>( site->key_.load( std::memory_order_relaxed ) ) );
+            os << '\n';
+            for ( auto f = size_t{ 0 }; f < site->depth_; ++f )
+            {
+                os << "        ";
+                print_address( os, site->stack_[f] );
+                os << '\n';
+            }
+        }
+    }
+
+    static auto report_at_exit() -> void
+    {
+        static auto registered = std::atomic_flag{};
+        if ( !registered.test_and_set() )
+        {
+            std::atexit( []
+            {
+                report( std::cout );
+            } );
+        }
+    }
+
+private:
+    struct alignas( 16 ) Header
+    {
+        void* raw_;
+        size_t size_;
+    };
+
+    struct alignas( 64 ) ThreadSlot
+    {
+        std::array<std::atomic<std::uint64_t>, num_size_classes> counts_{};
+        std::array<std::atomic<std::uint64_t>, num_size_classes> bytes_{};
+        std::atomic<std::uint64_t> frees_{};
+    };
+
+    struct CallSite
+    {
+        std::atomic<std::uintptr_t> key_{ 0 };
+        std::atomic<bool> ready_{ false };
+        std::atomic<std::uint64_t> count_{ 0 };
+        std::atomic<std::uint64_t> bytes_{ 0 };
+        std::array<void*, max_stack_depth> stack_{};
+        size_t depth_{ 0 };
+    };
+
+    struct State
+    {
+        std::array<ThreadSlot, max_threads> threads_{};
+        std::atomic<size_t> next_slot_{ 0 };
+        std::array<CallSite, max_call_sites> call_sites_{};
+        std::atomic<std::int64_t> live_bytes_{ 0 };
+        std::atomic<std::int64_t> peak_live_bytes_{ 0 };
+        std::atomic<bool> capture_stacks_{ false };
+    };
+
+    // Constant initialized, so it is usable by allocations made before main()
+    static auto state() noexcept -> State&
+    {
+        static constinit State s{};
+        return s;
+    }
+
+    // Keeps the tracker from recording its own allocations (e.g. backtrace() or the report's output)
+    struct ReentrancyGuard
+    {
+        ReentrancyGuard() noexcept : active_{ !inside() }
+        {
+            inside() = true;
+        }
+        ~ReentrancyGuard()
+        {
+            if ( active_ )
+            {
+                inside() = false;
+            }
+        }
+        static auto inside() noexcept -> bool&
+        {
+            static thread_local constinit bool flag = false;
+            return flag;
+        }
+        bool active_{};
+    };
+
+    static auto size_class( size_t size ) noexcept -> size_t
+    {
+        if ( size <= 16 )
+        {
+            return 0;
+        }
+        const auto c = static_cast<size_t>( std::bit_width( size - 1 ) ) - 4;
+        return std::min( c, num_size_classes - 1 );
+    }
+
+    static auto thread_slot() noexcept -> ThreadSlot&
+    {
+        static thread_local constinit size_t index = max_threads;
+        if ( index == max_threads )
+        {
+            index = std::min( state().next_slot_.fetch_add( 1, std::memory_order_relaxed ), max_threads - 1 );
+        }
+        return state().threads_[index];
+    }
+
+    static auto record_allocation( size_t size, void* call_site ) noexcept -> void
+    {
+        auto& s = state();
+        auto& slot = thread_slot();
+        const auto c = size_class( size );
+        slot.counts_[c].fetch_add( 1, std::memory_order_relaxed );
+        slot.bytes_[c].fetch_add( size, std::memory_order_relaxed );
+
+        const auto live = s.live_bytes_.fetch_add( static_cast<std::int64_t>( size ), std::memory_order_relaxed ) +
+            static_cast<std::int64_t>( size );
+        auto peak = s.peak_live_bytes_.load( std::memory_order_relaxed );
+        while ( live > peak && !s.peak_live_bytes_.compare_exchange_weak( peak, live, std::memory_order_relaxed ) )
+        {}
+
+        if ( !ReentrancyGuard::inside() )
+        {
+            record_call_site( size, call_site );
+        }
+    }
+
+    static auto record_deallocation( size_t size ) noexcept -> void
+    {
+        thread_slot().frees_.fetch_add( 1, std::memory_order_relaxed );
+        state().live_bytes_.fetch_sub( static_cast<std::int64_t>( size ), std::memory_order_relaxed );
+    }
+
+    // Open addressing with linear probing, entries are never removed
+    static auto record_call_site( size_t size, void* call_site ) noexcept -> void
+    {
+        auto& s = state();
+        const auto key = reinterpret_cast<std::uintptr_t>( call_site );
+        auto index = static_cast<size_t>( ( key >> 4 ) * 0x9E3779B97F4A7C15ull ) % max_call_sites;
+        for ( auto probe = size_t{ 0 }; probe < max_call_sites; ++probe, index = ( index + 1 ) % max_call_sites )
+        {
+            auto& site = s.call_sites_[index];
+            auto expected = site.key_.load( std::memory_order_acquire );
+            if ( expected == 0 && site.key_.compare_exchange_strong( expected, key, std::memory_order_acq_rel ) )
+            {
+                // We own this new entry
+                if ( s.capture_stacks_.load( std::memory_order_relaxed ) )
+                {
+                    auto guard = ReentrancyGuard{};
+                    site.depth_ = capture_stack( call_site, site.stack_ );
+                }
+                site.ready_.store( true, std::memory_order_release );
+                expected = key;
+            }
+            if ( expected == key )
+            {
+                site.count_.fetch_add( 1, std::memory_order_relaxed );
+                site.bytes_.fetch_add( size, std::memory_order_relaxed );
+                return;
+            }
+        }
+        // Table full, the allocation is still counted per size class
+    }
+
+    // Captures the callers of call_site, the tracker's own frames are skipped
+    static auto capture_stack( void* call_site, std::array<void*, max_stack_depth>& frames ) noexcept -> size_t
+    {
+        void* raw[max_stack_depth + 8]{};
+#if defined(_MSC_VER)
+        const auto n = static_cast<size_t>( CaptureStackBackTrace( 0, static_cast<DWORD>( std::size( raw ) ), raw, nullptr ) );
+#else
+        const auto n = static_cast<size_t>( backtrace( raw, static_cast<int>( std::size( raw ) ) ) );
+#endif
+        const auto it = std::find( raw, raw + n, call_site );
+        const auto first = ( it == raw + n ) ? raw : it + 1;
+        const auto depth = std::min( static_cast<size_t>( raw + n - first ), max_stack_depth );
+        std::copy_n( first, depth, frames.begin() );
+        return depth;
+    }
+
+    static auto print_address( std::ostream& os, void* address ) -> void
+    {
+#if !defined(_MSC_VER)
+        if ( auto** symbols = backtrace_symbols( &address, 1 ) )
+        {
+            os << symbols[0];
+            std::free( symbols );
+            return;
+        }
+#endif
+        os << address;
+    }
+};
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// A statistical micro-benchmark harness.
+//
+// A single ScopedTimer run measures one sample, cold caches and turbo ramp-up included.
+// run_benchmark() instead:
+// 1. Warms up the code (caches, branch predictors, page faults, CPU frequency).
+// 2. Picks the number of iterations per sample adaptively, so that each sample is long
+//    enough to be far above the clock resolution.
+// 3. Collects many samples and rejects outliers with Tukey's fences (interrupts, migrations...).
+// 4. Reports the median and the tail (p90/p99) instead of a single number.
+
+// Prevent the compiler from optimizing away a value we computed but never use
+template <class T>
+inline void DoNotOptimize( const T& value )
+{
+#if defined(_MSC_VER)
+    static volatile const void* sink;
+    sink = &value;
+    _ReadWriteBarrier();
+#else
+    asm volatile( "" : : "r,m"( value ) : "memory" );
+#endif
+}
+
+template <class T>
+inline void DoNotOptimize( T& value )
+{
+#if defined(_MSC_VER)
+    static volatile const void* sink;
+    sink = &value;
+    _ReadWriteBarrier();
+#elif defined(__clang__)
+    asm volatile( "" : "+r,m"( value ) : : "memory" );
+#else
+    asm volatile( "" : "+m,r"( value ) : : "memory" );
+#endif
+}
+
+// Force all pending writes to memory, so stores into a buffer are not elided
+inline void ClobberMemory()
+{
+#if defined(_MSC_VER)
+    _ReadWriteBarrier();
+#else
+    asm volatile( "" : : : "memory" );
+#endif
+}
+
+struct BenchmarkOptions
+{
+    std::chrono::nanoseconds warmup_time{ std::chrono::milliseconds{ 100 } };
+    std::chrono::nanoseconds min_sample_time{ std::chrono::milliseconds{ 2 } };
+    std::chrono::nanoseconds max_total_time{ std::chrono::seconds{ 2 } };
+    size_t min_samples{ 10 };
+    size_t max_samples{ 100 };
+    double outlier_fence{ 1.5 }; // Tukey's k, samples outside [Q1 - k * IQR, Q3 + k * IQR] are rejected
+};
+
+struct BenchmarkResult
+{
+    std::string name_;
+    size_t iterations_per_sample_{};
+    std::vector<double> samples_ns_; // Time per iteration of the kept samples, sorted
+    size_t outliers_{};
+    double mean_ns_{};
+    double stddev_ns_{};
+    double min_ns_{};
+    double median_ns_{};
+    double p90_ns_{};
+    double p99_ns_{};
+    double max_ns_{};
+};
+
+namespace detail
+{
+    // Linear interpolation between closest ranks, sorted must not be empty
+    inline auto percentile( const std::vector<double>& sorted, double p ) -> double
+    {
+        const auto rank = p * static_cast<double>( sorted.size() - 1 );
+        const auto lo = static_cast<size_t>( std::floor( rank ) );
+        const auto hi = std::min( lo + 1, sorted.size() - 1 );
+        return std::lerp( sorted[lo], sorted[hi], rank - static_cast<double>( lo ) );
+    }
+
+    inline auto format_duration( double ns ) -> std::string
+    {
+        char buf[32];
+        if ( ns < 1e3 )
+            std::snprintf( buf, sizeof( buf ), "%.2f ns", ns );
+        else if ( ns < 1e6 )
+            std::snprintf( buf, sizeof( buf ), "%.2f us", ns / 1e3 );
+        else if ( ns < 1e9 )
+            std::snprintf( buf, sizeof( buf ), "%.2f ms", ns / 1e6 );
+        else
+            std::snprintf( buf, sizeof( buf ), "%.2f s", ns / 1e9 );
+        return buf;
+    }
+}
+
+inline auto summarize_samples( std::string name, std::vector<double> samples,
+                               size_t iterations_per_sample, double outlier_fence ) -> BenchmarkResult
+{
+    auto result = BenchmarkResult{};
+    result.name_ = std::move( name );
+    result.iterations_per_sample_ = iterations_per_sample;
+    if ( samples.empty() )
+    {
+        return result;
+    }
+
+    std::sort( samples.begin(), samples.end() );
+    const auto q1 = detail::percentile( samples, 0.25 );
+    const auto q3 = detail::percentile( samples, 0.75 );
+    const auto iqr = q3 - q1;
+    const auto lower = q1 - outlier_fence * iqr;
+    const auto upper = q3 + outlier_fence * iqr;
+
+    const auto total = samples.size();
+    std::erase_if( samples, [ = ] ( double s )
+    {
+        return s < lower || s > upper;
+    } );
+    result.outliers_ = total - samples.size();
+
+    const auto n = static_cast<double>( samples.size() );
+    result.mean_ns_ = std::accumulate( samples.begin(), samples.end(), 0.0 ) / n;
+    const auto sq = std::accumulate( samples.begin(), samples.end(), 0.0, [ & ] ( double acc, double s )
+    {
+        return acc + ( s - result.mean_ns_ ) * ( s - result.mean_ns_ );
+    } );
+    result.stddev_ns_ = samples.size() > 1 ? std::sqrt( sq / ( n - 1 ) ) : 0.0;
+    result.min_ns_ = samples.front();
+    result.max_ns_ = samples.back();
+    result.median_ns_ = detail::percentile( samples, 0.5 );
+    result.p90_ns_ = detail::percentile( samples, 0.9 );
+    result.p99_ns_ = detail::percentile( samples, 0.99 );
+    result.samples_ns_ = std::move( samples );
+    return result;
+}
+
+inline auto print_result( std::ostream& os, const BenchmarkResult& r ) -> void
+{
+    using detail::format_duration;
+    os << r.name_ << '\n'
+       << "    median " << format_duration( r.median_ns_ )
+       << "  p90 " << format_duration( r.p90_ns_ )
+       << "  p99 " << format_duration( r.p99_ns_ )
+       << "  mean " << format_duration( r.mean_ns_ ) << " +- " << format_duration( r.stddev_ns_ )
+       << "\n    " << r.samples_ns_.size() << " samples x " << r.iterations_per_sample_ << " iterations, "
+       << r.outliers_ << " outlier(s) rejected\n";
+}
+
+// Shared state between run_benchmark() and the entry runner (see MainEntryHelper.h):
+// which benchmarks to run, the thread count parallel code should use, and the collected results.
+class BenchmarkContext
+{
+public:
+    struct Record
+    {
+        std::string entry_;
+        size_t repetition_{};
+        size_t threads_{};
+        BenchmarkResult result_;
+    };
+
+    static auto instance() -> BenchmarkContext&
+    {
+        static auto context = BenchmarkContext{};
+        return context;
+    }
+
+    // Number of worker threads parallel algorithms should use, hardware concurrency by default
+    static auto threads() -> size_t
+    {
+        const auto& c = instance();
+        return c.threads_ != 0 ? c.threads_ : std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+    }
+
+    auto set_threads( size_t n ) -> void
+    {
+        threads_ = n;
+    }
+    auto set_filter( const std::string& pattern ) -> void
+    {
+        filter_ = std::regex{ pattern };
+    }
+    auto set_max_time( std::chrono::nanoseconds max_time ) -> void
+    {
+        max_time_ = max_time;
+    }
+    auto set_current( std::string entry, size_t repetition ) -> void
+    {
+        entry_ = std::move( entry );
+        repetition_ = repetition;
+    }
+
+    auto should_run( const std::string& name ) const -> bool
+    {
+        return !filter_ || std::regex_search( name, *filter_ );
+    }
+    // The options a benchmark asked for, with the total time capped by --max-time
+    auto options( const BenchmarkOptions& requested ) const -> BenchmarkOptions
+    {
+        auto result = requested;
+        if ( max_time_ )
+        {
+            result.max_total_time = std::min( result.max_total_time, *max_time_ );
+            result.warmup_time = std::min( result.warmup_time, *max_time_ );
+        }
+        return result;
+    }
+    auto record( const BenchmarkResult& result ) -> void
+    {
+        records_.push_back( Record{ entry_, repetition_, threads(), result } );
+    }
+    auto records() const -> const std::vector<Record>&
+    {
+        return records_;
+    }
+
+private:
+    BenchmarkContext() = default;
+
+    size_t threads_{ 0 };
+    std::optional<std::regex> filter_;
+    std::optional<std::chrono::nanoseconds> max_time_;
+    std::string entry_;
+    size_t repetition_{};
+    std::vector<Record> records_;
+};
+
+template <class F>
+auto run_benchmark( std::string name, F&& f, const BenchmarkOptions& requested_options = {} ) -> BenchmarkResult
+{
+    using ClockType = std::chrono::steady_clock;
+
+    auto& context = BenchmarkContext::instance();
+    if ( !context.should_run( name ) )
+    {
+        auto result = BenchmarkResult{};
+        result.name_ = std::move( name );
+        return result;
+    }
+    const auto options = context.options( requested_options );
+
+    const auto run_batch = [ & ] ( size_t iterations )
+    {
+        const auto start = ClockType::now();
+        for ( auto i = size_t{ 0 }; i < iterations; ++i )
+        {
+            f();
+        }
+        ClobberMemory();
+        return ClockType::now() - start;
+    };
+
+    // Warmup, at least once
+    const auto warmup_start = ClockType::now();
+    do
+    {
+        run_batch( 1 );
+    }
+    while ( ClockType::now() - warmup_start < options.warmup_time );
+
+    // Grow the batch until one sample takes at least min_sample_time
+    auto iterations = size_t{ 1 };
+    auto elapsed = run_batch( iterations );
+    while ( elapsed < options.min_sample_time )
+    {
+        const auto ratio = static_cast<double>( options.min_sample_time.count() ) /
+            static_cast<double>( std::max<ClockType::rep>( elapsed.count(), 1 ) );
+        iterations = static_cast<size_t>( static_cast<double>( iterations ) * std::clamp( ratio * 1.2, 2.0, 10.0 ) );
+        elapsed = run_batch( iterations );
+    }
+
+    auto samples = std::vector<double>{};
+    samples.reserve( options.max_samples );
+    const auto sampling_start = ClockType::now();
+    while ( samples.size() < options.max_samples )
+    {
+        const auto ns = std::chrono::duration<double, std::nano>( run_batch( iterations ) ).count();
+        samples.push_back( ns / static_cast<double>( iterations ) );
+        if ( samples.size() >= options.min_samples &&
+             ClockType::now() - sampling_start >= options.max_total_time )
+        {
+            break;
+        }
+    }
+
+    auto result = summarize_samples( std::move( name ), std::move( samples ), iterations, options.outlier_fence );
+    print_result( std::cout, result );
+    context.record( result );
+    return result;
+}
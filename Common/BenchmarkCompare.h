@@ -0,0 +1,431 @@
+#pragma once
+
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Compares a run against a baseline saved with --format=json.
+//
+// A single median moving by 10% means little when the samples themselves spread by 20%.
+// A benchmark is only flagged when both:
+// 1. The Mann-Whitney U test says the two sample sets are unlikely to come from the same
+//    distribution (p < alpha). It is rank based, so it doesn't assume normally distributed
+//    timings and a few remaining outliers can't dominate it.
+// 2. The median moved by more than the threshold. The noise is already accounted for by the test,
+//    the spread of the baseline (interquartile range / median) is only printed for information.
+// Benchmarks are matched by entry, name and thread count. Repetitions are pooled together.
+
+struct BaselineSamples
+{
+    std::string entry_;
+    std::string name_;
+    size_t threads_{};
+    std::vector<double> samples_ns_; // Sorted
+};
+
+enum class ComparisonStatus
+{
+    Unchanged,
+    Improvement,
+    Regression,
+    New,
+    NotComparable // The baseline median is 0, there is no relative change
+};
+
+struct BenchmarkComparison
+{
+    std::string entry_;
+    std::string name_;
+    size_t threads_{};
+    double baseline_median_ns_{};
+    double current_median_ns_{};
+    double change_{};    // Relative change of the median, +0.1 is 10% slower
+    double threshold_{}; // Relative threshold
+    double noise_{};     // Interquartile range of the baseline, relative to its median
+    double p_value_{ 1.0 };
+    ComparisonStatus status_{ ComparisonStatus::Unchanged };
+};
+
+namespace detail
+{
+    // Just enough of a JSON reader for the files written by EntryRunner:
+    // {"benchmarks":[{"key":"string" or number or [numbers], ...}, ...]}
+    class BaselineReader
+    {
+    public:
+        explicit BaselineReader( std::string text ) : text_{ std::move( text ) }
+        {}
+
+        auto read() -> std::optional<std::vector<BaselineSamples>>
+        {
+            auto result = std::vector<BaselineSamples>{};
+            if ( !consume( '{' ) )
+            {
+                return std::nullopt;
+            }
+            while ( !consume( '}' ) )
+            {
+                const auto key = read_string();
+                if ( !key || !consume( ':' ) )
+                {
+                    return std::nullopt;
+                }
+                if ( *key != "benchmarks" )
+                {
+                    if ( !skip_value() )
+                        return std::nullopt;
+                }
+                else if ( !read_benchmarks( result ) )
+                {
+                    return std::nullopt;
+                }
+                consume( ',' );
+            }
+            return result;
+        }
+
+    private:
+        auto read_benchmarks( std::vector<BaselineSamples>& out ) -> bool
+        {
+            if ( !consume( '[' ) )
+            {
+                return false;
+            }
+            while ( !consume( ']' ) )
+            {
+                if ( !consume( '{' ) )
+                {
+                    return false;
+                }
+                auto b = BaselineSamples{};
+                while ( !consume( '}' ) )
+                {
+                    const auto key = read_string();
+                    if ( !key || !consume( ':' ) )
+                    {
+                        return false;
+                    }
+                    auto ok = true;
+                    if ( *key == "entry" || *key == "name" )
+                    {
+                        const auto s = read_string();
+                        ok = s.has_value();
+                        ( *key == "entry" ? b.entry_ : b.name_ ) = s.value_or( "" );
+                    }
+                    else if ( *key == "threads" )
+                    {
+                        const auto n = read_number();
+                        ok = n.has_value();
+                        b.threads_ = static_cast<size_t>( n.value_or( 0.0 ) );
+                    }
+                    else if ( *key == "samples_ns" )
+                    {
+                        ok = read_numbers( b.samples_ns_ );
+                    }
+                    else
+                    {
+                        ok = skip_value();
+                    }
+                    if ( !ok )
+                    {
+                        return false;
+                    }
+                    consume( ',' );
+                }
+                std::sort( b.samples_ns_.begin(), b.samples_ns_.end() );
+                out.push_back( std::move( b ) );
+                consume( ',' );
+            }
+            return true;
+        }
+
+        auto skip_whitespace() -> void
+        {
+            while ( pos_ < text_.size() && std::isspace( static_cast<unsigned char>( text_[pos_] ) ) )
+            {
+                ++pos_;
+            }
+        }
+        auto consume( char c ) -> bool
+        {
+            skip_whitespace();
+            if ( pos_ < text_.size() && text_[pos_] == c )
+            {
+                ++pos_;
+                return true;
+            }
+            return false;
+        }
+        auto read_string() -> std::optional<std::string>
+        {
+            if ( !consume( '"' ) )
+            {
+                return std::nullopt;
+            }
+            auto s = std::string{};
+            while ( pos_ < text_.size() && text_[pos_] != '"' )
+            {
+                if ( text_[pos_] == '\\' && pos_ + 1 < text_.size() )
+                {
+                    ++pos_;
+                }
+                s += text_[pos_++];
+            }
+            if ( pos_ == text_.size() )
+            {
+                return std::nullopt;
+            }
+            ++pos_;
+            return s;
+        }
+        auto read_number() -> std::optional<double>
+        {
+            skip_whitespace();
+            const auto begin = text_.c_str() + pos_;
+            char* end = nullptr;
+            const auto value = std::strtod( begin, &end );
+            if ( end == begin )
+            {
+                return std::nullopt;
+            }
+            pos_ += static_cast<size_t>( end - begin );
+            return value;
+        }
+        auto read_numbers( std::vector<double>& out ) -> bool
+        {
+            if ( !consume( '[' ) )
+            {
+                return false;
+            }
+            while ( !consume( ']' ) )
+            {
+                const auto n = read_number();
+                if ( !n )
+                {
+                    return false;
+                }
+                out.push_back( *n );
+                consume( ',' );
+            }
+            return true;
+        }
+        auto skip_value() -> bool
+        {
+            skip_whitespace();
+            if ( pos_ == text_.size() )
+            {
+                return false;
+            }
+            if ( text_[pos_] == '"' )
+            {
+                return read_string().has_value();
+            }
+            if ( text_[pos_] == '[' || text_[pos_] == '{' )
+            {
+                // Nested values, skip to the matching bracket
+                auto depth = 0;
+                do
+                {
+                    if ( text_[pos_] == '"' )
+                    {
+                        if ( !read_string() )
+                            return false;
+                        continue;
+                    }
+                    if ( text_[pos_] == '[' || text_[pos_] == '{' )
+                        ++depth;
+                    else if ( text_[pos_] == ']' || text_[pos_] == '}' )
+                        --depth;
+                    ++pos_;
+                }
+                while ( depth > 0 && pos_ < text_.size() );
+                return depth == 0;
+            }
+            // Numbers, true, false, null
+            while ( pos_ < text_.size() && text_[pos_] != ',' && text_[pos_] != '}' && text_[pos_] != ']' )
+            {
+                ++pos_;
+            }
+            return true;
+        }
+
+        std::string text_;
+        size_t pos_{ 0 };
+    };
+}
+
+inline auto load_baseline( const std::string& path ) -> std::optional<std::vector<BaselineSamples>>
+{
+    auto in = std::ifstream{ path };
+    if ( !in )
+    {
+        return std::nullopt;
+    }
+    auto ss = std::stringstream{};
+    ss << in.rdbuf();
+    return detail::BaselineReader{ ss.str() }.read();
+}
+
+// Two-sided p-value of the Mann-Whitney U test, normal approximation with tie and continuity correction.
+// Fine from about 5 samples per side, which is the least run_benchmark() collects by default.
+inline auto mann_whitney_u( const std::vector<double>& a, const std::vector<double>& b ) -> double
+{
+    const auto n1 = static_cast<double>( a.size() );
+    const auto n2 = static_cast<double>( b.size() );
+    if ( a.empty() || b.empty() )
+    {
+        return 1.0;
+    }
+
+    // Rank the pooled samples, ties get the average of their ranks
+    auto pooled = std::vector<std::pair<double, bool>>{}; // value, from a
+    pooled.reserve( a.size() + b.size() );
+    for ( auto v : a )
+        pooled.emplace_back( v, true );
+    for ( auto v : b )
+        pooled.emplace_back( v, false );
+    std::sort( pooled.begin(), pooled.end() );
+
+    auto rank_sum_a = 0.0;
+    auto tie_term = 0.0;
+    for ( auto i = size_t{ 0 }; i < pooled.size(); )
+    {
+        auto j = i;
+        while ( j < pooled.size() && pooled[j].first == pooled[i].first )
+        {
+            ++j;
+        }
+        const auto rank = ( static_cast<double>( i + 1 ) + static_cast<double>( j ) ) / 2.0;
+        for ( auto k = i; k < j; ++k )
+        {
+            if ( pooled[k].second )
+                rank_sum_a += rank;
+        }
+        const auto t = static_cast<double>( j - i );
+        tie_term += t * t * t - t;
+        i = j;
+    }
+
+    const auto n = n1 + n2;
+    const auto u = rank_sum_a - n1 * ( n1 + 1.0 ) / 2.0;
+    const auto mean = n1 * n2 / 2.0;
+    const auto variance = n1 * n2 / 12.0 * ( ( n + 1.0 ) - tie_term / ( n * ( n - 1.0 ) ) );
+    if ( variance <= 0.0 )
+    {
+        return 1.0;
+    }
+    const auto z = std::max( std::abs( u - mean ) - 0.5, 0.0 ) / std::sqrt( variance );
+    return std::erfc( z / std::sqrt( 2.0 ) );
+}
+
+inline auto compare_to_baseline( const std::vector<BaselineSamples>& baseline,
+                                 const std::vector<BenchmarkContext::Record>& records,
+                                 double threshold, double alpha ) -> std::vector<BenchmarkComparison>
+{
+    using Key = std::tuple<std::string, std::string, size_t>;
+    const auto pool = [] ( auto& map, const Key& key, const std::vector<double>& samples )
+    {
+        auto& pooled = map[key];
+        pooled.insert( pooled.end(), samples.begin(), samples.end() );
+    };
+
+    auto before = std::map<Key, std::vector<double>>{};
+    for ( const auto& b : baseline )
+    {
+        pool( before, Key{ b.entry_, b.name_, b.threads_ }, b.samples_ns_ );
+    }
+    auto after = std::map<Key, std::vector<double>>{};
+    for ( const auto& r : records )
+    {
+        pool( after, Key{ r.entry_, r.result_.name_, r.threads_ }, r.result_.samples_ns_ );
+    }
+
+    auto result = std::vector<BenchmarkComparison>{};
+    for ( auto& [key, current] : after )
+    {
+        auto c = BenchmarkComparison{};
+        std::tie( c.entry_, c.name_, c.threads_ ) = key;
+        if ( current.empty() )
+        {
+            continue;
+        }
+        std::sort( current.begin(), current.end() );
+        c.current_median_ns_ = detail::percentile( current, 0.5 );
+
+        const auto it = before.find( key );
+        if ( it == before.end() || it->second.empty() )
+        {
+            c.status_ = ComparisonStatus::New;
+            result.push_back( std::move( c ) );
+            continue;
+        }
+        auto& previous = it->second;
+        std::sort( previous.begin(), previous.end() );
+        c.baseline_median_ns_ = detail::percentile( previous, 0.5 );
+        c.threshold_ = threshold;
+        if ( !( c.baseline_median_ns_ > 0.0 ) )
+        {
+            c.status_ = ComparisonStatus::NotComparable;
+            result.push_back( std::move( c ) );
+            continue;
+        }
+        c.change_ = c.current_median_ns_ / c.baseline_median_ns_ - 1.0;
+        c.noise_ = ( detail::percentile( previous, 0.75 ) - detail::percentile( previous, 0.25 ) ) / c.baseline_median_ns_;
+        c.p_value_ = mann_whitney_u( previous, current );
+        if ( c.p_value_ < alpha && std::abs( c.change_ ) > c.threshold_ )
+        {
+            c.status_ = c.change_ > 0.0 ? ComparisonStatus::Regression : ComparisonStatus::Improvement;
+        }
+        result.push_back( std::move( c ) );
+    }
+    return result;
+}
+
+inline auto print_comparisons( std::ostream& os, const std::vector<BenchmarkComparison>& comparisons ) -> void
+{
+    using detail::format_duration;
+    for ( const auto& c : comparisons )
+    {
+        os << c.entry_ << '/' << c.name_ << " [" << c.threads_ << " threads]\n    ";
+        if ( c.status_ == ComparisonStatus::New )
+        {
+            os << "new, median " << format_duration( c.current_median_ns_ ) << '\n';
+            continue;
+        }
+        if ( c.status_ == ComparisonStatus::NotComparable )
+        {
+            os << format_duration( c.baseline_median_ns_ ) << " -> " << format_duration( c.current_median_ns_ )
+               << "  not comparable (baseline median is 0)\n";
+            continue;
+        }
+        char buf[128];
+        std::snprintf( buf, sizeof( buf ), "%+.1f%% (threshold %.1f%%, baseline spread %.1f%%, p = %.3f)",
+                       c.change_ * 100.0, c.threshold_ * 100.0, c.noise_ * 100.0, c.p_value_ );
+        os << format_duration( c.baseline_median_ns_ ) << " -> " << format_duration( c.current_median_ns_ ) << "  " << buf;
+        switch ( c.status_ )
+        {
+        case ComparisonStatus::Regression:
+            os << "  REGRESSION\n";
+            break;
+        case ComparisonStatus::Improvement:
+            os << "  improvement\n";
+            break;
+        default:
+            os << "  unchanged\n";
+            break;
+        }
+    }
+}
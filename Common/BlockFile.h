@@ -0,0 +1,534 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "AlignedAllocator.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef NOMINMAX
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Sequential block I/O for large binary files.
+//
+// An istreambuf_iterator goes through the stream buffer one byte at a time, with a virtual call whenever
+// its small buffer runs out, and the read itself happens while nothing else does. BlockFileReader reads
+// whole blocks (1 MiB by default) into page aligned buffers, and reads the next block on another thread
+// while the caller decodes the current one (double buffering). BlockFileWriter does the same the other way:
+// the caller fills a block while the previous one is written.
+//
+// With IoMode::Direct the file is opened with O_DIRECT (FILE_FLAG_NO_BUFFERING on Windows), so blocks go
+// between the device and the buffers by DMA, bypassing the OS page cache: no copy, and a file read once doesn't
+// evict everything else from the cache. That is why the buffers are page aligned and whole pages are transferred.
+// Filesystems without direct I/O support (e.g. tmpfs) fall back to buffered I/O, see direct().
+//
+// The buffers come from an IoBufferPool, so a reader or writer opened in a loop doesn't allocate.
+//
+//     auto reader = BlockFileReader{ "postings.bin", IoMode::Direct };
+//     for ( auto block = reader.next_block(); !block.empty(); block = reader.next_block() )
+//     {
+//         decode( block ); // The next block is read meanwhile
+//     }
+
+enum class IoMode
+{
+    Buffered,
+    Direct
+};
+
+// Page aligned buffers of block_size bytes, reused
+class IoBufferPool
+{
+public:
+    static constexpr size_t alignment = 4096; // Direct I/O needs the logical block size of the device, 4 KiB covers all
+
+    using Buffer = AlignedBuffer<std::byte, alignment>;
+
+    // A buffer from the pool, going back to it when destroyed
+    class Handle
+    {
+    public:
+        Handle() noexcept = default;
+        Handle( IoBufferPool* pool, Buffer buffer ) noexcept : pool_{ pool }, buffer_{ std::move( buffer ) }
+        {}
+        Handle( Handle&& other ) noexcept : pool_{ std::exchange( other.pool_, nullptr ) }, buffer_{ std::move( other.buffer_ ) }
+        {}
+        auto operator=( Handle&& other ) noexcept -> Handle&
+        {
+            auto tmp = std::move( other );
+            std::swap( pool_, tmp.pool_ );
+            std::swap( buffer_, tmp.buffer_ );
+            return *this;
+        }
+        ~Handle()
+        {
+            if ( pool_ != nullptr )
+            {
+                pool_->release( std::move( buffer_ ) );
+            }
+        }
+
+        auto data() noexcept -> std::byte*
+        {
+            return buffer_.data();
+        }
+        auto size() const noexcept -> size_t
+        {
+            return buffer_.size();
+        }
+
+    private:
+        IoBufferPool* pool_{ nullptr };
+        Buffer buffer_;
+    };
+
+    explicit IoBufferPool( size_t block_size = size_t{ 1 } << 20 )
+        : block_size_{ ( std::max( block_size, alignment ) + alignment - 1 ) & ~( alignment - 1 ) }
+    {}
+    IoBufferPool( const IoBufferPool& ) = delete;
+    IoBufferPool& operator=( const IoBufferPool& ) = delete;
+
+    auto block_size() const noexcept -> size_t
+    {
+        return block_size_;
+    }
+
+    auto acquire() -> Handle
+    {
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            if ( !free_.empty() )
+            {
+                auto buffer = std::move( free_.back() );
+                free_.pop_back();
+                return Handle{ this, std::move( buffer ) };
+            }
+        }
+        return Handle{ this, Buffer( block_size_ ) };
+    }
+
+private:
+    auto release( Buffer buffer ) noexcept -> void
+    {
+        auto lck = std::scoped_lock{ mutex_ };
+        try
+        {
+            free_.push_back( std::move( buffer ) );
+        }
+        catch ( ... )
+        {} // The buffer is freed instead
+    }
+
+    size_t block_size_;
+    std::mutex mutex_;
+    std::vector<Buffer> free_;
+};
+
+// Shared by the readers and writers not given a pool
+inline auto io_buffer_pool() -> IoBufferPool&
+{
+    static auto pool = IoBufferPool{};
+    return pool;
+}
+
+//-------------------------------------------------------------------------
+
+namespace detail
+{
+#if defined(_WIN32)
+    using FileHandle = HANDLE;
+    inline const auto invalid_file = INVALID_HANDLE_VALUE;
+
+    [[noreturn]] inline auto throw_io_error( const char* what ) -> void
+    {
+        throw std::system_error{ static_cast<int>( ::GetLastError() ), std::system_category(), what };
+    }
+
+    inline auto open_file( const std::filesystem::path& path, bool write, IoMode mode, bool& direct ) -> FileHandle
+    {
+        const auto access = write ? GENERIC_WRITE : GENERIC_READ;
+        const auto disposition = write ? CREATE_ALWAYS : OPEN_EXISTING;
+        auto file = INVALID_HANDLE_VALUE;
+        if ( mode == IoMode::Direct )
+        {
+            file = ::CreateFileW( path.c_str(), access, FILE_SHARE_READ, nullptr, disposition,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+        }
+        direct = file != INVALID_HANDLE_VALUE;
+        if ( !direct )
+        {
+            file = ::CreateFileW( path.c_str(), access, FILE_SHARE_READ, nullptr, disposition,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+        }
+        if ( file == INVALID_HANDLE_VALUE )
+        {
+            throw_io_error( "CreateFile" );
+        }
+        return file;
+    }
+
+    inline auto read_at( FileHandle file, std::byte* p, size_t n, std::uint64_t offset ) -> size_t
+    {
+        auto total = size_t{ 0 };
+        while ( total < n )
+        {
+            auto overlapped = OVERLAPPED{};
+            overlapped.Offset = static_cast<DWORD>( offset + total );
+            overlapped.OffsetHigh = static_cast<DWORD>( ( offset + total ) >> 32 );
+            auto read = DWORD{};
+            if ( !::ReadFile( file, p + total, static_cast<DWORD>( n - total ), &read, &overlapped ) )
+            {
+                if ( ::GetLastError() == ERROR_HANDLE_EOF )
+                {
+                    break;
+                }
+                throw_io_error( "ReadFile" );
+            }
+            if ( read == 0 )
+            {
+                break;
+            }
+            total += read;
+        }
+        return total;
+    }
+
+    inline auto write_at( FileHandle file, const std::byte* p, size_t n, std::uint64_t offset ) -> void
+    {
+        auto total = size_t{ 0 };
+        while ( total < n )
+        {
+            auto overlapped = OVERLAPPED{};
+            overlapped.Offset = static_cast<DWORD>( offset + total );
+            overlapped.OffsetHigh = static_cast<DWORD>( ( offset + total ) >> 32 );
+            auto written = DWORD{};
+            if ( !::WriteFile( file, p + total, static_cast<DWORD>( n - total ), &written, &overlapped ) )
+            {
+                throw_io_error( "WriteFile" );
+            }
+            total += written;
+        }
+    }
+
+    inline auto truncate_file( FileHandle file, std::uint64_t size ) -> void
+    {
+        auto info = FILE_END_OF_FILE_INFO{};
+        info.EndOfFile.QuadPart = static_cast<LONGLONG>( size );
+        if ( !::SetFileInformationByHandle( file, FileEndOfFileInfo, &info, sizeof( info ) ) )
+        {
+            throw_io_error( "SetFileInformationByHandle" );
+        }
+    }
+
+    inline auto close_file( FileHandle file ) noexcept -> void
+    {
+        ::CloseHandle( file );
+    }
+#else
+    using FileHandle = int;
+    inline constexpr auto invalid_file = -1;
+
+    [[noreturn]] inline auto throw_io_error( const char* what ) -> void
+    {
+        throw std::system_error{ errno, std::generic_category(), what };
+    }
+
+    inline auto open_file( const std::filesystem::path& path, bool write, IoMode mode, bool& direct ) -> FileHandle
+    {
+        const auto flags = O_CLOEXEC | ( write ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY );
+        auto fd = -1;
+#if defined(O_DIRECT)
+        if ( mode == IoMode::Direct )
+        {
+            fd = ::open( path.c_str(), flags | O_DIRECT, 0644 ); // EINVAL if the filesystem doesn't support it
+        }
+#endif
+        direct = fd >= 0;
+        if ( !direct )
+        {
+            fd = ::open( path.c_str(), flags, 0644 );
+        }
+        if ( fd < 0 )
+        {
+            throw_io_error( "open" );
+        }
+#if defined(POSIX_FADV_SEQUENTIAL)
+        if ( !direct && !write )
+        {
+            ::posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL ); // Bigger read-ahead
+        }
+#endif
+        return fd;
+    }
+
+    inline auto read_at( FileHandle fd, std::byte* p, size_t n, std::uint64_t offset ) -> size_t
+    {
+        auto total = size_t{ 0 };
+        while ( total < n )
+        {
+            const auto read = ::pread( fd, p + total, n - total, static_cast<off_t>( offset + total ) );
+            if ( read < 0 )
+            {
+                if ( errno == EINTR )
+                {
+                    continue;
+                }
+                throw_io_error( "pread" );
+            }
+            if ( read == 0 )
+            {
+                break;
+            }
+            total += static_cast<size_t>( read );
+        }
+        return total;
+    }
+
+    inline auto write_at( FileHandle fd, const std::byte* p, size_t n, std::uint64_t offset ) -> void
+    {
+        auto total = size_t{ 0 };
+        while ( total < n )
+        {
+            const auto written = ::pwrite( fd, p + total, n - total, static_cast<off_t>( offset + total ) );
+            if ( written < 0 )
+            {
+                if ( errno == EINTR )
+                {
+                    continue;
+                }
+                throw_io_error( "pwrite" );
+            }
+            total += static_cast<size_t>( written );
+        }
+    }
+
+    inline auto truncate_file( FileHandle fd, std::uint64_t size ) -> void
+    {
+        if ( ::ftruncate( fd, static_cast<off_t>( size ) ) != 0 )
+        {
+            throw_io_error( "ftruncate" );
+        }
+    }
+
+    inline auto close_file( FileHandle fd ) noexcept -> void
+    {
+        ::close( fd );
+    }
+#endif
+}
+
+//-------------------------------------------------------------------------
+
+class BlockFileReader
+{
+public:
+    explicit BlockFileReader( const std::filesystem::path& path, IoMode mode = IoMode::Buffered, IoBufferPool& pool = io_buffer_pool() )
+        : pool_{ &pool }, file_{ detail::open_file( path, false, mode, direct_ ) }
+    {
+        try
+        {
+            start_read();
+        }
+        catch ( ... )
+        {
+            detail::close_file( file_ );
+            throw;
+        }
+    }
+    BlockFileReader( const BlockFileReader& ) = delete;
+    BlockFileReader& operator=( const BlockFileReader& ) = delete;
+    ~BlockFileReader()
+    {
+        if ( pending_.valid() )
+        {
+            pending_.wait(); // It reads into next_
+        }
+        detail::close_file( file_ );
+    }
+
+    // The next block of the file, empty at the end. Valid until the next call.
+    auto next_block() -> std::span<const std::byte>
+    {
+        if ( !pending_.valid() )
+        {
+            return {};
+        }
+        const auto n = pending_.get();
+        current_ = std::move( next_ );
+        if ( n == pool_->block_size() )
+        {
+            start_read(); // The next block is read while the caller processes this one
+        }
+        return { current_.data(), n };
+    }
+
+    // Whether the file is read with direct I/O
+    auto direct() const noexcept -> bool
+    {
+        return direct_;
+    }
+
+private:
+    auto start_read() -> void
+    {
+        next_ = pool_->acquire();
+        pending_ = std::async( std::launch::async, [ file = file_, p = next_.data(), n = pool_->block_size(), offset = offset_ ]
+        {
+            return detail::read_at( file, p, n, offset );
+        } );
+        offset_ += pool_->block_size();
+    }
+
+    IoBufferPool* pool_;
+    bool direct_{ false };
+    detail::FileHandle file_;
+    std::uint64_t offset_{ 0 };
+    IoBufferPool::Handle current_; // Handed out by next_block()
+    IoBufferPool::Handle next_;    // Being read
+    std::future<size_t> pending_;
+};
+
+class BlockFileWriter
+{
+public:
+    explicit BlockFileWriter( const std::filesystem::path& path, IoMode mode = IoMode::Buffered, IoBufferPool& pool = io_buffer_pool() )
+        : pool_{ &pool }, file_{ detail::open_file( path, true, mode, direct_ ) }
+    {
+        try
+        {
+            current_ = pool_->acquire();
+        }
+        catch ( ... )
+        {
+            detail::close_file( file_ );
+            throw;
+        }
+    }
+    BlockFileWriter( const BlockFileWriter& ) = delete;
+    BlockFileWriter& operator=( const BlockFileWriter& ) = delete;
+    // Call close() to know whether everything was written, errors are ignored here
+    ~BlockFileWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch ( ... )
+        {}
+    }
+
+    auto put( std::byte b ) -> void
+    {
+        if ( used_ == pool_->block_size() ) [[unlikely]]
+        {
+            submit( used_ );
+        }
+        current_.data()[used_++] = b;
+    }
+    auto write( std::span<const std::byte> bytes ) -> void
+    {
+        while ( !bytes.empty() )
+        {
+            if ( used_ == pool_->block_size() )
+            {
+                submit( used_ );
+            }
+            const auto n = std::min( bytes.size(), pool_->block_size() - used_ );
+            std::memcpy( current_.data() + used_, bytes.data(), n );
+            used_ += n;
+            bytes = bytes.subspan( n );
+        }
+    }
+
+    // Writes what is left and closes the file
+    auto close() -> void
+    {
+        if ( file_ == detail::invalid_file )
+        {
+            return;
+        }
+        auto file = std::exchange( file_, detail::invalid_file );
+        try
+        {
+            const auto size = offset_ + used_;
+            if ( used_ > 0 )
+            {
+                // Direct I/O only writes whole pages, the padding is cut off afterwards
+                const auto n = direct_ ? ( used_ + IoBufferPool::alignment - 1 ) & ~( IoBufferPool::alignment - 1 ) : used_;
+                std::memset( current_.data() + used_, 0, n - used_ );
+                wait_pending();
+                detail::write_at( file, current_.data(), n, offset_ );
+                if ( n != used_ )
+                {
+                    detail::truncate_file( file, size );
+                }
+            }
+            else
+            {
+                wait_pending();
+            }
+        }
+        catch ( ... )
+        {
+            detail::close_file( file );
+            throw;
+        }
+        detail::close_file( file );
+    }
+
+    // Whether the file is written with direct I/O
+    auto direct() const noexcept -> bool
+    {
+        return direct_;
+    }
+
+private:
+    auto wait_pending() -> void
+    {
+        if ( pending_.valid() )
+        {
+            pending_.get(); // Rethrows a write error
+        }
+    }
+
+    // Writes the current block in the background and continues in another buffer
+    auto submit( size_t n ) -> void
+    {
+        wait_pending();
+        writing_ = std::move( current_ );
+        current_ = pool_->acquire();
+        pending_ = std::async( std::launch::async, [ file = file_, p = writing_.data(), n, offset = offset_ ]
+        {
+            detail::write_at( file, p, n, offset );
+        } );
+        offset_ += n;
+        used_ = 0;
+    }
+
+    IoBufferPool* pool_;
+    bool direct_{ false };
+    detail::FileHandle file_;
+    std::uint64_t offset_{ 0 }; // Of the current block in the file
+    size_t used_{ 0 };
+    IoBufferPool::Handle current_; // Being filled
+    IoBufferPool::Handle writing_; // Being written
+    std::future<void> pending_;
+};
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef NOMINMAX
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+// Cache and TLB topology of the machine, so block sizes can be derived from the hardware
+// instead of hard-coding the numbers of one particular CPU.
+//
+// Caches come from sysfs on Linux (/sys/devices/system/cpu/cpu0/cache) and from
+// GetLogicalProcessorInformation() on Windows. TLBs are not exposed by either, they are read
+// with cpuid (leaf 0x18 on Intel, 0x80000005/0x80000006 on AMD).
+// Anything that can't be detected is simply missing from the lists.
+
+struct CacheLevel
+{
+    int level_{};
+    char type_{};                // 'D'ata, 'I'nstruction or 'U'nified
+    size_t size_{};              // Bytes
+    size_t line_size_{};         // Bytes
+    size_t associativity_{};     // Ways, 0 if fully associative
+    size_t shared_cpus_{};       // Logical CPUs sharing this cache
+};
+
+struct TlbLevel
+{
+    int level_{};
+    char type_{};                // 'D'ata, 'I'nstruction or 'U'nified
+    size_t entries_{};
+    size_t associativity_{};     // Ways, 0 if fully associative
+    std::string page_sizes_;
+};
+
+struct CacheTopology
+{
+    std::vector<CacheLevel> caches_;
+    std::vector<TlbLevel> tlbs_;
+    size_t page_size_{ 4096 };
+
+    // Size of the data (or unified) cache at a level, 0 if unknown
+    auto data_cache_size( int level ) const -> size_t
+    {
+        for ( const auto& c : caches_ )
+        {
+            if ( c.level_ == level && c.type_ != 'I' )
+            {
+                return c.size_;
+            }
+        }
+        return 0;
+    }
+    auto last_level_cache_size() const -> size_t
+    {
+        auto result = CacheLevel{};
+        for ( const auto& c : caches_ )
+        {
+            if ( c.type_ != 'I' && c.level_ >= result.level_ )
+            {
+                result = c;
+            }
+        }
+        return result.size_;
+    }
+    auto line_size() const -> size_t
+    {
+        for ( const auto& c : caches_ )
+        {
+            if ( c.line_size_ != 0 )
+            {
+                return c.line_size_;
+            }
+        }
+        return 64;
+    }
+};
+
+namespace detail
+{
+    // Returns false if the leaf is not supported (or not an x86 CPU)
+    inline auto cpuid( std::uint32_t leaf, std::uint32_t subleaf, std::uint32_t ( &regs )[4] ) -> bool
+    {
+#if defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+        int r[4]{};
+        __cpuid( r, static_cast<int>( leaf & 0x80000000u ) );
+        if ( static_cast<std::uint32_t>( r[0] ) < leaf )
+        {
+            return false;
+        }
+        __cpuidex( r, static_cast<int>( leaf ), static_cast<int>( subleaf ) );
+        std::copy( std::begin( r ), std::end( r ), std::begin( regs ) );
+        return true;
+#elif defined(__x86_64__) || defined(__i386__)
+        if ( __get_cpuid_max( leaf & 0x80000000u, nullptr ) < leaf )
+        {
+            return false;
+        }
+        __cpuid_count( leaf, subleaf, regs[0], regs[1], regs[2], regs[3] );
+        return true;
+#else
+        ( void )leaf;
+        ( void )subleaf;
+        ( void )regs;
+        return false;
+#endif
+    }
+
+    inline auto cpu_vendor() -> std::string
+    {
+        std::uint32_t regs[4]{};
+        if ( !cpuid( 0, 0, regs ) )
+        {
+            return {};
+        }
+        char vendor[13]{};
+        std::copy_n( reinterpret_cast<const char*>( &regs[1] ), 4, vendor );     // EBX
+        std::copy_n( reinterpret_cast<const char*>( &regs[3] ), 4, vendor + 4 ); // EDX
+        std::copy_n( reinterpret_cast<const char*>( &regs[2] ), 4, vendor + 8 ); // ECX
+        return vendor;
+    }
+
+    inline auto detect_tlbs() -> std::vector<TlbLevel>
+    {
+        auto tlbs = std::vector<TlbLevel>{};
+        std::uint32_t regs[4]{};
+        const auto vendor = cpu_vendor();
+        if ( vendor == "GenuineIntel" && cpuid( 0x18, 0, regs ) )
+        {
+            // Deterministic address translation parameters, one sub-leaf per TLB
+            const auto max_subleaf = regs[0];
+            for ( auto sub = std::uint32_t{ 0 }; sub <= max_subleaf; ++sub )
+            {
+                cpuid( 0x18, sub, regs );
+                const auto type = regs[3] & 0x1f;
+                if ( type == 0 )
+                {
+                    continue;
+                }
+                auto tlb = TlbLevel{};
+                tlb.level_ = static_cast<int>( ( regs[3] >> 5 ) & 0x7 );
+                tlb.type_ = type == 2 ? 'I' : type == 3 ? 'U' : 'D'; // 1 data, 4 load only, 5 store only
+                const auto ways = regs[1] >> 16;
+                tlb.entries_ = static_cast<size_t>( ways ) * regs[2];
+                tlb.associativity_ = ( regs[3] & ( 1u << 8 ) ) ? 0 : ways;
+                const char* page_sizes[] = { "4K", "2M", "4M", "1G" };
+                for ( auto bit = 0; bit < 4; ++bit )
+                {
+                    if ( regs[1] & ( 1u << bit ) )
+                    {
+                        tlb.page_sizes_ += tlb.page_sizes_.empty() ? "" : "/";
+                        tlb.page_sizes_ += page_sizes[bit];
+                    }
+                }
+                tlbs.push_back( tlb );
+            }
+        }
+        else if ( vendor == "AuthenticAMD" && cpuid( 0x80000006, 0, regs ) )
+        {
+            // 4K page data TLBs only. The L1 associativity is a plain count (0xff is fully associative),
+            // the L2 one is encoded, see the AMD CPUID specification.
+            std::uint32_t l1[4]{};
+            cpuid( 0x80000005, 0, l1 );
+            const auto l1_ways = l1[1] >> 24;
+            tlbs.push_back( TlbLevel{ 1, 'D', ( l1[1] >> 16 ) & 0xff, l1_ways == 0xff ? 0 : l1_ways, "4K" } );
+
+            constexpr size_t l2_ways[16] = { 0, 1, 2, 3, 4, 6, 8, 0, 16, 0, 32, 48, 64, 96, 128, 0 };
+            const auto ways_code = regs[1] >> 28;
+            tlbs.push_back( TlbLevel{ 2, 'D', ( regs[1] >> 16 ) & 0xfff, ways_code == 0xf ? 0 : l2_ways[ways_code], "4K" } );
+        }
+        return tlbs;
+    }
+
+#if !defined(_WIN32)
+    inline auto read_sysfs( const std::string& path ) -> std::string
+    {
+        auto in = std::ifstream{ path };
+        auto value = std::string{};
+        std::getline( in, value );
+        return value;
+    }
+
+    // "48K", "2048K", "32M"
+    inline auto parse_sysfs_size( const std::string& s ) -> size_t
+    {
+        auto value = size_t{ 0 };
+        auto i = size_t{ 0 };
+        for ( ; i < s.size() && s[i] >= '0' && s[i] <= '9'; ++i )
+        {
+            value = value * 10 + static_cast<size_t>( s[i] - '0' );
+        }
+        if ( i < s.size() )
+        {
+            switch ( s[i] )
+            {
+            case 'K': value <<= 10; break;
+            case 'M': value <<= 20; break;
+            case 'G': value <<= 30; break;
+            default: break;
+            }
+        }
+        return value;
+    }
+
+    // "0-3,8,10-11" -> 7
+    inline auto count_cpu_list( const std::string& s ) -> size_t
+    {
+        auto count = size_t{ 0 };
+        auto pos = size_t{ 0 };
+        while ( pos < s.size() )
+        {
+            const auto end = std::min( s.find( ',', pos ), s.size() );
+            const auto range = s.substr( pos, end - pos );
+            const auto dash = range.find( '-' );
+            if ( dash == std::string::npos )
+                count += 1;
+            else
+                count += parse_sysfs_size( range.substr( dash + 1 ) ) - parse_sysfs_size( range.substr( 0, dash ) ) + 1;
+            pos = end + 1;
+        }
+        return count;
+    }
+#endif
+
+    inline auto detect_caches() -> std::vector<CacheLevel>
+    {
+        auto caches = std::vector<CacheLevel>{};
+#if defined(_WIN32)
+        auto buffer_size = DWORD{ 0 };
+        GetLogicalProcessorInformation( nullptr, &buffer_size );
+        auto buffer = std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION>( buffer_size / sizeof( SYSTEM_LOGICAL_PROCESSOR_INFORMATION ) );
+        if ( buffer.empty() || !GetLogicalProcessorInformation( buffer.data(), &buffer_size ) )
+        {
+            return caches;
+        }
+        for ( const auto& info : buffer )
+        {
+            if ( info.Relationship != RelationCache )
+            {
+                continue;
+            }
+            auto c = CacheLevel{};
+            c.level_ = info.Cache.Level;
+            c.type_ = info.Cache.Type == CacheData ? 'D' : info.Cache.Type == CacheInstruction ? 'I' : 'U';
+            c.size_ = info.Cache.Size;
+            c.line_size_ = info.Cache.LineSize;
+            c.associativity_ = info.Cache.Associativity == 0xff ? 0 : info.Cache.Associativity;
+            c.shared_cpus_ = static_cast<size_t>( std::popcount( static_cast<std::uint64_t>( info.ProcessorMask ) ) );
+            // Reported once per instance, keep one of each
+            const auto seen = std::any_of( caches.begin(), caches.end(), [ & ] ( const CacheLevel& other )
+            {
+                return other.level_ == c.level_ && other.type_ == c.type_;
+            } );
+            if ( !seen )
+            {
+                caches.push_back( c );
+            }
+        }
+#else
+        // cpu0 is representative on everything but hybrid CPUs
+        for ( auto index = 0;; ++index )
+        {
+            const auto dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string( index ) + "/";
+            const auto level = read_sysfs( dir + "level" );
+            if ( level.empty() )
+            {
+                break;
+            }
+            const auto type = read_sysfs( dir + "type" );
+            auto c = CacheLevel{};
+            c.level_ = std::stoi( level );
+            c.type_ = type == "Data" ? 'D' : type == "Instruction" ? 'I' : 'U';
+            c.size_ = parse_sysfs_size( read_sysfs( dir + "size" ) );
+            c.line_size_ = parse_sysfs_size( read_sysfs( dir + "coherency_line_size" ) );
+            c.associativity_ = parse_sysfs_size( read_sysfs( dir + "ways_of_associativity" ) );
+            c.shared_cpus_ = count_cpu_list( read_sysfs( dir + "shared_cpu_list" ) );
+            caches.push_back( c );
+        }
+#endif
+        std::sort( caches.begin(), caches.end(), [] ( const CacheLevel& a, const CacheLevel& b )
+        {
+            return a.level_ != b.level_ ? a.level_ < b.level_ : a.type_ < b.type_;
+        } );
+        return caches;
+    }
+}
+
+inline auto detect_cache_topology() -> CacheTopology
+{
+    auto topology = CacheTopology{};
+    topology.caches_ = detail::detect_caches();
+    topology.tlbs_ = detail::detect_tlbs();
+#if defined(_WIN32)
+    auto info = SYSTEM_INFO{};
+    GetSystemInfo( &info );
+    topology.page_size_ = info.dwPageSize;
+#else
+    topology.page_size_ = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+#endif
+    return topology;
+}
+
+// Detected once
+inline auto cache_topology() -> const CacheTopology&
+{
+    static const auto topology = detect_cache_topology();
+    return topology;
+}
+
+inline auto print_cache_topology( std::ostream& os, const CacheTopology& t ) -> void
+{
+    const auto kib = [] ( size_t bytes )
+    {
+        return bytes >= ( size_t{ 1 } << 20 ) && bytes % ( size_t{ 1 } << 20 ) == 0
+            ? std::to_string( bytes >> 20 ) + " MiB"
+            : std::to_string( bytes >> 10 ) + " KiB";
+    };
+
+    os << "Page size: " << t.page_size_ << " bytes\n";
+    if ( t.caches_.empty() )
+    {
+        os << "Caches: unknown\n";
+    }
+    for ( const auto& c : t.caches_ )
+    {
+        os << "L" << c.level_ << c.type_ << ": " << kib( c.size_ ) << ", " << c.line_size_ << " byte lines, ";
+        if ( c.associativity_ == 0 )
+            os << "fully associative";
+        else
+            os << c.associativity_ << "-way";
+        os << ", shared by " << c.shared_cpus_ << " CPU(s)\n";
+    }
+    for ( const auto& tlb : t.tlbs_ )
+    {
+        os << "L" << tlb.level_ << " " << tlb.type_ << "TLB: " << tlb.entries_ << " entries (" << tlb.page_sizes_ << " pages), ";
+        if ( tlb.associativity_ == 0 )
+            os << "fully associative\n";
+        else
+            os << tlb.associativity_ << "-way\n";
+    }
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// A monotonic arena that many threads can allocate from at once, for the temporary buffers of a parallel phase.
+//
+// Arena<N> (CustomAllocator.cpp) bumps a plain pointer, so the tasks of a parallel algorithm can't share it,
+// and each of them goes to malloc for its buffers instead. ConcurrentArena bumps an atomic offset into one big
+// buffer, and to keep the threads from all hitting that atomic, each thread takes a chunk_size piece of it at a time
+// and bumps a thread-local pointer inside its piece. Allocations bigger than a quarter of a chunk take their bytes
+// from the shared offset directly.
+//
+// Nothing is freed one by one. When the phase is over (the tasks joined), reset() makes the whole buffer available
+// again in O(1). If the buffer runs out, allocations fall back to the upstream resource (behind a mutex),
+// and reset() frees those too.
+//
+//     auto arena = ConcurrentArena{ 64 << 20 };
+//     // In every task:
+//     auto tmp = std::pmr::vector<float>{ &arena };
+//     // After the tasks are joined:
+//     arena.reset();
+//
+// A thread keeps one piece for one arena at a time, so a thread allocating from two arenas in turn
+// leaves the rest of its piece unused at every switch.
+
+class ConcurrentArena : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t chunk_size = size_t{ 64 } << 10;
+    static constexpr size_t buffer_alignment = 64;
+
+    explicit ConcurrentArena( size_t capacity, std::pmr::memory_resource* upstream = std::pmr::get_default_resource() )
+        : capacity_{ ( capacity + buffer_alignment - 1 ) & ~( buffer_alignment - 1 ) }, upstream_{ upstream },
+          buffer_{ static_cast<std::byte*>( upstream->allocate( capacity_, buffer_alignment ) ) }
+    {}
+    ConcurrentArena( const ConcurrentArena& ) = delete;
+    ConcurrentArena& operator=( const ConcurrentArena& ) = delete;
+    ~ConcurrentArena()
+    {
+        release_overflow();
+        upstream_->deallocate( buffer_, capacity_, buffer_alignment );
+    }
+
+    // Everything allocated so far becomes invalid.
+    // Not thread safe: call it between parallel phases, when no thread allocates.
+    auto reset() -> void
+    {
+        offset_.store( 0, std::memory_order_relaxed );
+        generation_.store( next_generation(), std::memory_order_relaxed ); // Invalidates the threads' pieces
+        release_overflow();
+    }
+
+    // Bytes taken from the buffer since the last reset, including the unused ends of the threads' pieces
+    auto used() const noexcept -> size_t
+    {
+        return std::min( offset_.load( std::memory_order_relaxed ), capacity_ );
+    }
+    auto capacity() const noexcept -> size_t
+    {
+        return capacity_;
+    }
+    // Allocations since the last reset that didn't fit in the buffer
+    auto overflow_allocations() const -> size_t
+    {
+        auto lck = std::scoped_lock{ overflow_mutex_ };
+        return overflow_.size();
+    }
+
+private:
+    struct ThreadPiece
+    {
+        std::uint64_t generation_; // Of the arena the piece was taken from, 0 for none
+        std::byte* ptr_;
+        std::byte* end_;
+    };
+
+    struct OverflowBlock
+    {
+        void* p_;
+        size_t bytes_;
+        size_t align_;
+    };
+
+    // Unique across arenas, a new arena at the address of a destroyed one doesn't see the old pieces
+    static auto next_generation() noexcept -> std::uint64_t
+    {
+        static auto counter = std::atomic<std::uint64_t>{ 0 };
+        return counter.fetch_add( 1, std::memory_order_relaxed ) + 1;
+    }
+
+    static auto align_up( std::byte* p, size_t align ) noexcept -> std::byte*
+    {
+        const auto address = reinterpret_cast<std::uintptr_t>( p );
+        return p + ( ( align - ( address & ( align - 1 ) ) ) & ( align - 1 ) );
+    }
+
+    auto do_allocate( size_t bytes, size_t align ) -> void* override
+    {
+        auto& piece = piece_;
+        if ( piece.generation_ == generation_.load( std::memory_order_relaxed ) )
+        {
+            auto* p = align_up( piece.ptr_, align );
+            if ( p <= piece.end_ && bytes <= static_cast<size_t>( piece.end_ - p ) )
+            {
+                piece.ptr_ = p + bytes;
+                return p;
+            }
+        }
+        return allocate_slow( bytes, align );
+    }
+
+    auto allocate_slow( size_t bytes, size_t align ) -> void*
+    {
+        if ( bytes > chunk_size / 4 || align > chunk_size / 4 )
+        {
+            if ( bytes > capacity_ || align > capacity_ )
+            {
+                return allocate_overflow( bytes, align ); // bytes + align - 1 could wrap
+            }
+            if ( auto* p = take( bytes + align - 1 ) )
+            {
+                return align_up( p, align );
+            }
+            return allocate_overflow( bytes, align );
+        }
+        auto* p = take( chunk_size );
+        if ( p == nullptr )
+        {
+            return allocate_overflow( bytes, align );
+        }
+        auto& piece = piece_;
+        piece.generation_ = generation_.load( std::memory_order_relaxed );
+        piece.end_ = p + chunk_size;
+        p = align_up( p, align );
+        piece.ptr_ = p + bytes;
+        return p;
+    }
+
+    // The only contended operation, once per piece
+    auto take( size_t bytes ) noexcept -> std::byte*
+    {
+        if ( bytes > capacity_ )
+        {
+            return nullptr;
+        }
+        const auto offset = offset_.fetch_add( bytes, std::memory_order_relaxed );
+        return offset <= capacity_ - bytes ? buffer_ + offset : nullptr;
+    }
+
+    auto allocate_overflow( size_t bytes, size_t align ) -> void*
+    {
+        auto lck = std::scoped_lock{ overflow_mutex_ };
+        overflow_.reserve( overflow_.size() + 1 );
+        auto* p = upstream_->allocate( bytes, align );
+        overflow_.push_back( OverflowBlock{ p, bytes, align } );
+        return p;
+    }
+
+    auto release_overflow() -> void
+    {
+        auto lck = std::scoped_lock{ overflow_mutex_ };
+        for ( const auto& block : overflow_ )
+        {
+            upstream_->deallocate( block.p_, block.bytes_, block.align_ );
+        }
+        overflow_.clear();
+    }
+
+    auto do_deallocate( void*, size_t, size_t ) -> void override
+    {} // Everything is freed at once by reset()
+
+    auto do_is_equal( const std::pmr::memory_resource& other ) const noexcept -> bool override
+    {
+        return this == &other;
+    }
+
+    const size_t capacity_;
+    std::pmr::memory_resource* upstream_;
+    std::byte* buffer_;
+    alignas( 64 ) std::atomic<size_t> offset_{ 0 }; // On its own cache line, the other members are read-only
+    alignas( 64 ) std::atomic<std::uint64_t> generation_{ next_generation() };
+    mutable std::mutex overflow_mutex_;
+    std::vector<OverflowBlock> overflow_;
+
+    static thread_local ThreadPiece piece_;
+};
+
+inline constinit thread_local ConcurrentArena::ThreadPiece ConcurrentArena::piece_{};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Recycling allocation for coroutine frames.
+//
+// Every call of a coroutine allocates its frame with operator new (unless the compiler can prove the frame
+// doesn't outlive the caller, which it rarely does for a Task handed to co_await). A request handler that awaits
+// a few nested Tasks pays a malloc and a free for each of them, every time.
+//
+// Promise types opt in by inheriting PoolAllocatedFrame:
+// - Frames of up to max_frame_size bytes come from thread-local free lists, one per 64 byte size bucket.
+//   A coroutine called over and over gets the frame of its previous call back, and after the first calls
+//   no more malloc happens. Frames freed on another thread go to that thread's lists.
+// - A coroutine taking std::allocator_arg_t, Alloc as its first parameters (after the object, for member functions)
+//   gets its frame from that allocator instead:
+//
+//       template <class Alloc>
+//       auto values( std::allocator_arg_t, const Alloc& alloc, int n ) -> MyGenerator<int>;
+//
+//       auto gen = values( std::allocator_arg, ScratchAllocator<std::byte>{}, 10 );
+//
+// A frame ends with a small trailer telling operator delete (which only gets the frame size) how to free it.
+
+class CoroutineFramePool
+{
+public:
+    static constexpr size_t granularity = 64;
+    static constexpr size_t bucket_count = 16;
+    static constexpr size_t max_frame_size = granularity * bucket_count; // Larger frames go straight to the heap
+    static constexpr size_t max_cached_frames = 256; // Per bucket and thread, the rest are freed
+
+    static auto allocate( size_t size ) -> void*
+    {
+        if ( size > max_frame_size )
+        {
+            ++cache_.heap_allocations_;
+            return ::operator new( size );
+        }
+        const auto b = bucket( size );
+        if ( auto* frame = cache_.heads_[b] ) [[likely]]
+        {
+            cache_.heads_[b] = frame->next_;
+            --cache_.counts_[b];
+            return frame;
+        }
+        ++cache_.heap_allocations_;
+        return ::operator new( bucket_size( b ) );
+    }
+
+    static auto deallocate( void* p, size_t size ) noexcept -> void
+    {
+        if ( size > max_frame_size )
+        {
+            ::operator delete( p, size );
+            return;
+        }
+        const auto b = bucket( size );
+        if ( cache_.state_ != thread_active ) [[unlikely]]
+        {
+            if ( cache_.state_ == thread_exited )
+            {
+                ::operator delete( p, bucket_size( b ) );
+                return;
+            }
+            static thread_local auto flusher = ThreadCacheFlusher{};
+            cache_.state_ = thread_active;
+        }
+        if ( cache_.counts_[b] == max_cached_frames )
+        {
+            ::operator delete( p, bucket_size( b ) );
+            return;
+        }
+        cache_.heads_[b] = ::new ( p ) FreeFrame{ cache_.heads_[b] };
+        ++cache_.counts_[b];
+    }
+
+    // Frames this thread had to take from the heap so far
+    static auto heap_allocations() noexcept -> size_t
+    {
+        return cache_.heap_allocations_;
+    }
+
+private:
+    struct FreeFrame
+    {
+        FreeFrame* next_;
+    };
+
+    static constexpr int thread_new = 0;
+    static constexpr int thread_active = 1;
+    static constexpr int thread_exited = 2; // The lists are freed, frames go straight back to the heap
+
+    struct ThreadCache
+    {
+        FreeFrame* heads_[bucket_count];
+        size_t counts_[bucket_count];
+        size_t heap_allocations_;
+        int state_;
+    };
+
+    // Frees the thread's cached frames when it exits
+    struct ThreadCacheFlusher
+    {
+        ~ThreadCacheFlusher()
+        {
+            for ( auto b = size_t{ 0 }; b < bucket_count; ++b )
+            {
+                while ( auto* frame = cache_.heads_[b] )
+                {
+                    cache_.heads_[b] = frame->next_;
+                    ::operator delete( frame, bucket_size( b ) );
+                }
+                cache_.counts_[b] = 0;
+            }
+            cache_.state_ = thread_exited;
+        }
+    };
+
+    static constexpr auto bucket( size_t size ) noexcept -> size_t
+    {
+        return ( size - 1 ) / granularity;
+    }
+    static constexpr auto bucket_size( size_t b ) noexcept -> size_t
+    {
+        return ( b + 1 ) * granularity;
+    }
+
+    // Trivially destructible, so it is still usable while other thread locals are destroyed
+    static thread_local ThreadCache cache_;
+};
+
+inline constinit thread_local CoroutineFramePool::ThreadCache CoroutineFramePool::cache_{};
+
+//-------------------------------------------------------------------------
+
+namespace detail
+{
+    struct FrameTrailer
+    {
+        void ( *deallocate_ )( void* frame, size_t size ) noexcept;
+    };
+
+    template <class ByteAlloc>
+    struct AllocatorFrameTrailer : FrameTrailer
+    {
+        ByteAlloc alloc_;
+    };
+
+    // The unit allocated from a caller's allocator, so the frame is aligned like one from operator new
+    struct alignas( __STDCPP_DEFAULT_NEW_ALIGNMENT__ ) FrameBlock
+    {
+        std::byte bytes_[__STDCPP_DEFAULT_NEW_ALIGNMENT__];
+    };
+
+    constexpr auto trailer_offset( size_t size ) noexcept -> size_t
+    {
+        return ( size + alignof( FrameBlock ) - 1 ) & ~( alignof( FrameBlock ) - 1 );
+    }
+}
+
+// Mixin for promise types
+struct PoolAllocatedFrame
+{
+    static auto operator new( size_t size ) -> void*
+    {
+        const auto total = detail::trailer_offset( size ) + sizeof( detail::FrameTrailer );
+        auto* frame = CoroutineFramePool::allocate( total );
+        const auto deallocate = [] ( void* p, size_t size ) noexcept
+        {
+            CoroutineFramePool::deallocate( p, detail::trailer_offset( size ) + sizeof( detail::FrameTrailer ) );
+        };
+        ::new ( static_cast<void*>( trailer( frame, size ) ) ) detail::FrameTrailer{ deallocate };
+        return frame;
+    }
+
+    template <class Alloc, class... Args>
+    static auto operator new( size_t size, std::allocator_arg_t, const Alloc& alloc, const Args&... ) -> void*
+    {
+        return allocate_with( size, alloc );
+    }
+
+    // Member function coroutines, the object comes first
+    template <class This, class Alloc, class... Args>
+    static auto operator new( size_t size, const This&, std::allocator_arg_t, const Alloc& alloc, const Args&... ) -> void*
+    {
+        return allocate_with( size, alloc );
+    }
+
+    static auto operator delete( void* frame, size_t size ) noexcept -> void
+    {
+        trailer( frame, size )->deallocate_( frame, size );
+    }
+
+private:
+    static auto trailer( void* frame, size_t size ) noexcept -> detail::FrameTrailer*
+    {
+        return reinterpret_cast<detail::FrameTrailer*>( static_cast<std::byte*>( frame ) + detail::trailer_offset( size ) );
+    }
+
+    template <class ByteAlloc>
+    static constexpr auto allocator_blocks( size_t size ) noexcept -> size_t
+    {
+        const auto total = detail::trailer_offset( size ) + sizeof( detail::AllocatorFrameTrailer<ByteAlloc> );
+        return ( total + sizeof( detail::FrameBlock ) - 1 ) / sizeof( detail::FrameBlock );
+    }
+
+    template <class Alloc>
+    static auto allocate_with( size_t size, const Alloc& alloc ) -> void*
+    {
+        using ByteAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<detail::FrameBlock>;
+        using Trailer = detail::AllocatorFrameTrailer<ByteAlloc>;
+        static_assert( alignof( Trailer ) <= alignof( detail::FrameBlock ), "Over-aligned allocators are not supported" );
+
+        const auto deallocate = [] ( void* p, size_t size ) noexcept
+        {
+            auto* t = static_cast<Trailer*>( trailer( p, size ) );
+            auto byte_alloc = std::move( t->alloc_ );
+            std::destroy_at( t );
+            std::allocator_traits<ByteAlloc>::deallocate( byte_alloc, static_cast<detail::FrameBlock*>( p ), allocator_blocks<ByteAlloc>( size ) );
+        };
+        auto byte_alloc = ByteAlloc( alloc );
+        auto* frame = std::allocator_traits<ByteAlloc>::allocate( byte_alloc, allocator_blocks<ByteAlloc>( size ) );
+        // The allocator is kept in the frame, operator delete has nothing else to free it with
+        ::new ( static_cast<void*>( trailer( frame, size ) ) ) Trailer{ { deallocate }, std::move( byte_alloc ) };
+        return frame;
+    }
+};
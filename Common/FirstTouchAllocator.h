@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "AlignedAllocator.h"
+
+// Parallel first-touch allocation for multi-threaded kernels.
+//
+// std::vector<float>( n ) value-initializes n floats on the calling thread. On a fresh allocation that also means
+// every page fault happens there, one after another, and on a NUMA machine every page ends up on that thread's node,
+// while the workers that process the data later sit on all nodes. The OS places a page where it is first touched.
+//
+// FirstTouchAllocator fixes both:
+// - construct() without arguments default-initializes, so UninitializedVector<float>( n ) doesn't write anything.
+// - allocate() faults the pages in from n_tasks threads, each one touching the chunk for_each_chunk() gives it.
+//   Use the same n_tasks as the algorithm consuming the data, and each worker finds its chunk already mapped
+//   and local (as long as the OS keeps threads where they are).
+// The storage starts on a cache line, like AlignedAllocator's, so vectorized kernels start on full vectors.
+//
+//     auto src = UninitializedVector<float>( n, FirstTouchAllocator<float>{ n_tasks } );
+//     for_each_chunk( n, n_tasks, [ & ] ( size_t start, size_t stop ) { /* initialize src[start, stop) */ } );
+
+// Runs f( start, stop ) for n_tasks chunks of ceil( n / n_tasks ) elements, one task each, and waits for all of them.
+// The same chunking as par_transform_naive.
+template <class Func>
+auto for_each_chunk( size_t n, size_t n_tasks, Func f ) -> void
+{
+    n_tasks = std::max( n_tasks, size_t{ 1 } );
+    const auto chunk_sz = ( n + n_tasks - 1 ) / n_tasks;
+    auto futures = std::vector<std::future<void>>{};
+    for ( auto i = size_t{ 0 }; i < n_tasks; ++i )
+    {
+        const auto start = chunk_sz * i;
+        if ( start < n )
+        {
+            const auto stop = std::min( chunk_sz * ( i + 1 ), n );
+            futures.emplace_back( std::async( std::launch::async, [ =, &f ] { f( start, stop ); } ) );
+        }
+    }
+    for ( auto&& fut : futures )
+    {
+        fut.get();
+    }
+}
+
+template <class T>
+struct FirstTouchAllocator
+{
+    using value_type = T;
+
+    // Smaller allocations are faulted in by whoever writes them first, a thread costs more than a few page faults
+    static constexpr size_t min_parallel_bytes = size_t{ 256 } << 10;
+
+    FirstTouchAllocator() noexcept : FirstTouchAllocator( std::thread::hardware_concurrency() )
+    {}
+    explicit FirstTouchAllocator( size_t n_tasks ) noexcept : n_tasks_{ std::max( n_tasks, size_t{ 1 } ) }
+    {}
+    template <class U>
+    FirstTouchAllocator( const FirstTouchAllocator<U>& other ) noexcept : n_tasks_{ other.n_tasks_ }
+    {}
+
+    auto allocate( size_t n ) -> T*
+    {
+        auto* p = AlignedAllocator<T>{}.allocate( n );
+        if ( n * sizeof( T ) >= min_parallel_bytes )
+        {
+            // Chunked by element, like the algorithm will be. A page on a chunk boundary is touched twice, that's harmless.
+            constexpr auto page_size = size_t{ 4096 };
+            auto* bytes = reinterpret_cast<std::byte*>( p );
+            for_each_chunk( n, n_tasks_, [ bytes ] ( size_t start, size_t stop )
+            {
+                auto* volatile_bytes = static_cast<volatile std::byte*>( bytes );
+                for ( auto offset = start * sizeof( T ); offset < stop * sizeof( T ); offset += page_size )
+                {
+                    volatile_bytes[offset] = std::byte{ 0 };
+                }
+            } );
+        }
+        return p;
+    }
+    auto deallocate( T* p, size_t n ) noexcept -> void
+    {
+        AlignedAllocator<T>{}.deallocate( p, n );
+    }
+
+    // Default-initialization instead of value-initialization, i.e. nothing at all for trivial types
+    template <class U>
+    auto construct( U* p ) noexcept( std::is_nothrow_default_constructible_v<U> ) -> void
+    {
+        ::new ( static_cast<void*>( p ) ) U;
+    }
+    template <class U, class... Args>
+    auto construct( U* p, Args&&... args ) -> void
+    {
+        std::construct_at( p, std::forward<Args>( args )... );
+    }
+
+    auto tasks() const noexcept -> size_t
+    {
+        return n_tasks_;
+    }
+
+    template <class U>
+    auto operator==( const FirstTouchAllocator<U>& ) const noexcept
+    {
+        return true; // Any of them can free what another allocated
+    }
+
+    template <class U> friend struct FirstTouchAllocator;
+private:
+    size_t n_tasks_;
+};
+
+// A vector whose elements are left uninitialized by resize() and the size constructor
+template <class T>
+using UninitializedVector = std::vector<T, FirstTouchAllocator<T>>;
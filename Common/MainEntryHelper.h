@@ -1,7 +1,403 @@
 #pragma once
 
+#include "Benchmark.h"
+#include "BenchmarkCompare.h"
+#include "TraceProfiler.h"
+
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Registration based runner shared by every chapter.
+//
+// Entry( FUNC ) registers a demo, main() then hands the command line to EntryRunner::run(),
+// which runs the selected demos and collects every run_benchmark() result along the way.
+//
+//   --list                   print the registered entries and exit
+//   --filter=<regex>         only run the entries whose name matches
+//   --bench-filter=<regex>   only run the benchmarks whose name matches
+//   --repeat=<n>             run the selected entries n times
+//   --threads=<n,m,...>      run the selected entries once per thread count (BenchmarkContext::threads())
+//   --max-time=<ms>          cap the sampling and warmup time of each benchmark
+//   --format=console|json|csv
+//   --out=<path>             the file the json/csv results are written to, required by those formats
+//                            (stdout is full of the demos' output)
+//   --trace[=<path>]         record a Chrome trace of the TRACE_SCOPE/MEASURE_FUNCTION scopes
+//   --baseline=<path>        compare against the results of a previous --format=json run,
+//                            the exit code is 2 if a benchmark regressed (see BenchmarkCompare.h)
+//   --threshold=<percent>    smallest median change reported by --baseline, 5% by default
+
+class EntryRunner
+{
+public:
+	static auto instance() -> EntryRunner&
+	{
+		static auto runner = EntryRunner{};
+		return runner;
+	}
+
+	auto add( const char* name, std::function<void()> func ) -> void
+	{
+		entries_.push_back( { name, std::move( func ) } );
+	}
+
+	auto run( int argc, char** argv ) -> int
+	{
+		auto options = parse( argc, argv );
+		if ( !options )
+		{
+			print_usage( std::cerr, argc > 0 ? argv[0] : "" );
+			return 1;
+		}
+
+		if ( options->list_ )
+		{
+			for ( const auto& e : entries_ )
+			{
+				std::cout << e.name_ << '\n';
+			}
+			return 0;
+		}
+
+		// Load the baseline first, so a bad path fails before a long run
+		auto baseline = std::optional<std::vector<BaselineSamples>>{};
+		if ( options->baseline_ )
+		{
+			baseline = load_baseline( *options->baseline_ );
+			if ( !baseline )
+			{
+				std::cerr << "Failed to read baseline " << *options->baseline_ << '\n';
+				return 1;
+			}
+		}
+
+		auto& context = BenchmarkContext::instance();
+		if ( options->bench_filter_ )
+		{
+			context.set_filter( *options->bench_filter_ );
+		}
+		if ( options->max_time_ )
+		{
+			context.set_max_time( *options->max_time_ );
+		}
+
+		auto trace = std::unique_ptr<TraceSession>{};
+		if ( options->trace_ )
+		{
+			trace = std::make_unique<TraceSession>( *options->trace_ );
+		}
+
+		for ( auto threads : options->threads_ )
+		{
+			context.set_threads( threads );
+			for ( auto repetition = size_t{ 0 }; repetition < options->repeat_; ++repetition )
+			{
+				for ( const auto& e : entries_ )
+				{
+					if ( options->filter_ && !std::regex_search( e.name_, *options->filter_ ) )
+					{
+						continue;
+					}
+					context.set_current( e.name_, repetition );
+					std::cout << e.name_ << " Begin \n\n";
+					e.func_();
+					std::cout << "\n" << e.name_ << " End \n\n";
+				}
+			}
+		}
+		trace.reset();
+
+		if ( options->format_ != Format::Console )
+		{
+			auto out = std::ofstream{ options->out_ };
+			if ( !out )
+			{
+				std::cerr << "Failed to open " << options->out_ << '\n';
+				return 1;
+			}
+			write_results( out, options->format_ );
+		}
+
+		if ( baseline )
+		{
+			const auto comparisons = compare_to_baseline( *baseline, context.records(), options->threshold_, comparison_alpha );
+			std::cout << "\n-- comparison against " << *options->baseline_ << " --\n";
+			print_comparisons( std::cout, comparisons );
+			const auto regressed = std::any_of( comparisons.begin(), comparisons.end(), [] ( const auto& c )
+			{
+				return c.status_ == ComparisonStatus::Regression;
+			} );
+			return regressed ? 2 : 0;
+		}
+		return 0;
+	}
+
+private:
+	static constexpr double comparison_alpha = 0.05;
+
+	enum class Format
+	{
+		Console,
+		Json,
+		Csv
+	};
+
+	struct Options
+	{
+		bool list_{ false };
+		std::optional<std::regex> filter_;
+		std::optional<std::string> bench_filter_;
+		size_t repeat_{ 1 };
+		std::vector<size_t> threads_{ 0 }; // 0 is hardware concurrency
+		std::optional<std::chrono::milliseconds> max_time_;
+		Format format_{ Format::Console };
+		std::string out_;
+		std::optional<std::string> trace_;
+		std::optional<std::string> baseline_;
+		double threshold_{ 0.05 };
+	};
+
+	struct Item
+	{
+		std::string name_;
+		std::function<void()> func_;
+	};
+
+	EntryRunner() = default;
+
+	static auto parse_number( std::string_view s ) -> std::optional<size_t>
+	{
+		auto value = size_t{};
+		const auto [ptr, ec] = std::from_chars( s.data(), s.data() + s.size(), value );
+		if ( ec != std::errc{} || ptr != s.data() + s.size() )
+		{
+			return std::nullopt;
+		}
+		return value;
+	}
+
+	static auto parse( int argc, char** argv ) -> std::optional<Options>
+	{
+		auto options = Options{};
+		for ( auto i = 1; i < argc; ++i )
+		{
+			const auto arg = std::string_view{ argv[i] };
+			const auto eq = arg.find( '=' );
+			const auto key = arg.substr( 0, eq );
+			const auto value = eq == std::string_view::npos ? std::string_view{} : arg.substr( eq + 1 );
+			try
+			{
+				if ( key == "--list" )
+				{
+					options.list_ = true;
+				}
+				else if ( key == "--filter" )
+				{
+					options.filter_ = std::regex{ std::string{ value } };
+				}
+				else if ( key == "--bench-filter" )
+				{
+					std::regex{ std::string{ value } }; // Validate it here
+					options.bench_filter_ = std::string{ value };
+				}
+				else if ( key == "--repeat" )
+				{
+					const auto n = parse_number( value );
+					if ( !n || *n == 0 )
+					{
+						return std::nullopt;
+					}
+					options.repeat_ = *n;
+				}
+				else if ( key == "--threads" )
+				{
+					options.threads_.clear();
+					for ( auto rest = value; !rest.empty(); )
+					{
+						const auto comma = std::min( rest.find( ',' ), rest.size() );
+						const auto n = parse_number( rest.substr( 0, comma ) );
+						if ( !n || *n == 0 )
+						{
+							return std::nullopt;
+						}
+						options.threads_.push_back( *n );
+						rest.remove_prefix( std::min( comma + 1, rest.size() ) );
+					}
+					if ( options.threads_.empty() )
+					{
+						return std::nullopt;
+					}
+				}
+				else if ( key == "--max-time" )
+				{
+					const auto n = parse_number( value );
+					if ( !n )
+					{
+						return std::nullopt;
+					}
+					options.max_time_ = std::chrono::milliseconds{ *n };
+				}
+				else if ( key == "--format" )
+				{
+					if ( value == "console" )
+						options.format_ = Format::Console;
+					else if ( value == "json" )
+						options.format_ = Format::Json;
+					else if ( value == "csv" )
+						options.format_ = Format::Csv;
+					else
+						return std::nullopt;
+				}
+				else if ( key == "--out" )
+				{
+					options.out_ = value;
+				}
+				else if ( key == "--trace" )
+				{
+					options.trace_ = value.empty()
+						? std::filesystem::path{ argv[0] }.stem().string() + ".trace.json"
+						: std::string{ value };
+				}
+				else if ( key == "--baseline" )
+				{
+					options.baseline_ = std::string{ value };
+				}
+				else if ( key == "--threshold" )
+				{
+					const auto n = parse_number( value );
+					if ( !n )
+					{
+						return std::nullopt;
+					}
+					options.threshold_ = static_cast<double>( *n ) / 100.0;
+				}
+				else
+				{
+					std::cerr << "Unknown option " << arg << '\n';
+					return std::nullopt;
+				}
+			}
+			catch ( const std::regex_error& e )
+			{
+				std::cerr << "Invalid regex in " << arg << ": " << e.what() << '\n';
+				return std::nullopt;
+			}
+		}
+		if ( options.format_ != Format::Console && options.out_.empty() )
+		{
+			std::cerr << "--format=json|csv requires --out\n";
+			return std::nullopt;
+		}
+		return options;
+	}
+
+	static auto print_usage( std::ostream& os, const char* program ) -> void
+	{
+		os << "Usage: " << program << " [options]\n"
+		   << "  --list                   print the registered entries and exit\n"
+		   << "  --filter=<regex>         only run the entries whose name matches\n"
+		   << "  --bench-filter=<regex>   only run the benchmarks whose name matches\n"
+		   << "  --repeat=<n>             run the selected entries n times\n"
+		   << "  --threads=<n,m,...>      run the selected entries once per worker thread count\n"
+		   << "  --max-time=<ms>          cap the sampling time of each benchmark\n"
+		   << "  --format=console|json|csv\n"
+		   << "  --out=<path>             file the json/csv results are written to (required by those formats)\n"
+		   << "  --trace[=<path>]         record a Chrome trace\n"
+		   << "  --baseline=<path>        compare against a previous --format=json run, exit code 2 on regression\n"
+		   << "  --threshold=<percent>    smallest median change reported by --baseline (default 5)\n";
+	}
+
+	static auto write_json_string( std::ostream& os, std::string_view s ) -> void
+	{
+		os << '"';
+		for ( auto c : s )
+		{
+			if ( c == '"' || c == '\\' )
+			{
+				os << '\\';
+			}
+			os << c;
+		}
+		os << '"';
+	}
+
+	// Quoted, with embedded quotes doubled (RFC 4180)
+	static auto write_csv_string( std::ostream& os, std::string_view s ) -> void
+	{
+		os << '"';
+		for ( auto c : s )
+		{
+			if ( c == '"' )
+			{
+				os << '"';
+			}
+			os << c;
+		}
+		os << '"';
+	}
+
+	static auto write_results( std::ostream& os, Format format ) -> void
+	{
+		const auto& records = BenchmarkContext::instance().records();
+		os.precision( 12 );
+		if ( format == Format::Csv )
+		{
+			os << "entry,name,repetition,threads,iterations,samples,outliers,mean_ns,stddev_ns,min_ns,median_ns,p90_ns,p99_ns,max_ns\n";
+			for ( const auto& record : records )
+			{
+				const auto& r = record.result_;
+				write_csv_string( os, record.entry_ );
+				os << ',';
+				write_csv_string( os, r.name_ );
+				os << ',' << record.repetition_ << ',' << record.threads_ << ','
+				   << r.iterations_per_sample_ << ',' << r.samples_ns_.size() << ',' << r.outliers_ << ','
+				   << r.mean_ns_ << ',' << r.stddev_ns_ << ',' << r.min_ns_ << ',' << r.median_ns_ << ','
+				   << r.p90_ns_ << ',' << r.p99_ns_ << ',' << r.max_ns_ << '\n';
+			}
+			return;
+		}
+
+		// Keep the raw samples, so runs can later be compared statistically
+		os << "{\"benchmarks\":[";
+		for ( auto i = size_t{ 0 }; i < records.size(); ++i )
+		{
+			const auto& record = records[i];
+			const auto& r = record.result_;
+			os << ( i == 0 ? "\n" : ",\n" ) << "{\"entry\":";
+			write_json_string( os, record.entry_ );
+			os << ",\"name\":";
+			write_json_string( os, r.name_ );
+			os << ",\"repetition\":" << record.repetition_
+			   << ",\"threads\":" << record.threads_
+			   << ",\"iterations\":" << r.iterations_per_sample_
+			   << ",\"outliers\":" << r.outliers_
+			   << ",\"mean_ns\":" << r.mean_ns_
+			   << ",\"stddev_ns\":" << r.stddev_ns_
+			   << ",\"min_ns\":" << r.min_ns_
+			   << ",\"median_ns\":" << r.median_ns_
+			   << ",\"p90_ns\":" << r.p90_ns_
+			   << ",\"p99_ns\":" << r.p99_ns_
+			   << ",\"max_ns\":" << r.max_ns_
+			   << ",\"samples_ns\":[";
+			for ( auto j = size_t{ 0 }; j < r.samples_ns_.size(); ++j )
+			{
+				os << ( j == 0 ? "" : "," ) << r.samples_ns_[j];
+			}
+			os << "]}";
+		}
+		os << "\n]}\n";
+	}
+
+	std::vector<Item> entries_;
+};
 
-#define Entry( FUNC_NAME ) std::cout<< #FUNC_NAME << " Begin \n\n"; \
-	FUNC_NAME(); \
-	std::cout << "\n" << #FUNC_NAME << " End \n\n"
\ No newline at end of file
+#define Entry( FUNC_NAME ) EntryRunner::instance().add( #FUNC_NAME, FUNC_NAME )
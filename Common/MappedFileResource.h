@@ -0,0 +1,635 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef NOMINMAX
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// A memory resource carving its allocations out of a memory mapped file.
+//
+// A table rebuilt at every start (parsing, sorting, filling a million element vector) can instead be built once
+// in a file and mapped at the next start: opening it is instant, and its pages are read in by the OS page cache
+// when they are touched, so it can be bigger than RAM.
+//
+// Raw pointers don't survive that, the file is mapped at another address by the next process. So containers
+// meant to be reopened use OffsetPtr, a pointer storing the distance from itself to its target, which is the same
+// wherever the mapping lands. MappedFileAllocator uses it as its pointer type, and PersistentVector<T> is a
+// std::vector on it:
+//
+//     auto file = MappedFileResource{ "levels.bin" };
+//     auto* levels = file.root<PersistentVector<short>>();
+//     if ( levels == nullptr ) // A new file
+//     {
+//         levels = &file.construct_root<PersistentVector<short>>( MappedFileAllocator<short>{ file } );
+//         levels->resize( 1'000'000 ); // ...
+//     }
+//
+// std::vector supports fancy pointers in every standard library, node based containers don't in libstdc++.
+// The file keeps the container's bytes as they are, so it can only be reopened by a build with the same layout
+// (same compiler, standard library and flags). The header records the compiler, library and debug settings
+// along with MappedFileOptions::layout_tag (to bump when the stored types change), and root<T>() checks the type
+// the root was constructed with. A file written otherwise is rejected, or started over with
+// recreate_if_incompatible. Only one MappedFileResource may have a file open at a time.
+//
+// On Linux the whole max_size is reserved up front and the file is mapped again in place when it grows,
+// so the mapping never moves while it is open. On Windows the view is remapped at the same address,
+// growing fails with std::bad_alloc if that address got taken in between.
+//
+// Blocks are rounded up to a power of two and freed blocks are kept in per-size free lists in the file,
+// so growing a vector reuses the memory of its previous buffers.
+
+// A pointer that stays valid when the memory holding both the pointer and its target is mapped somewhere else.
+// It is a fancy pointer (a contiguous iterator with pointer_traits), so standard containers can use it.
+template <class T>
+class OffsetPtr
+{
+public:
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = std::add_lvalue_reference_t<T>;
+    using iterator_category = std::random_access_iterator_tag;
+    using iterator_concept = std::contiguous_iterator_tag;
+    template <class U>
+    using rebind = OffsetPtr<U>;
+
+    OffsetPtr() noexcept = default;
+    OffsetPtr( std::nullptr_t ) noexcept
+    {}
+    OffsetPtr( T* p ) noexcept
+    {
+        set( p );
+    }
+    OffsetPtr( const OffsetPtr& other ) noexcept
+    {
+        set( other.get() ); // The offset is relative to this
+    }
+    template <class U> requires std::is_convertible_v<U*, T*>
+    OffsetPtr( const OffsetPtr<U>& other ) noexcept
+    {
+        set( other.get() );
+    }
+    // From void pointers, like a static_cast
+    template <class U> requires ( !std::is_convertible_v<U*, T*> && std::is_void_v<U> )
+    explicit OffsetPtr( const OffsetPtr<U>& other ) noexcept
+    {
+        set( static_cast<T*>( other.get() ) );
+    }
+    auto operator=( const OffsetPtr& other ) noexcept -> OffsetPtr&
+    {
+        set( other.get() );
+        return *this;
+    }
+
+    auto get() const noexcept -> T*
+    {
+        if ( offset_ == null_offset )
+        {
+            return nullptr;
+        }
+        auto* self = reinterpret_cast<const std::byte*>( this );
+        return reinterpret_cast<T*>( const_cast<std::byte*>( self + offset_ ) );
+    }
+    explicit operator bool() const noexcept
+    {
+        return offset_ != null_offset;
+    }
+    auto operator->() const noexcept -> T*
+    {
+        return get();
+    }
+    template <class U = T> requires ( !std::is_void_v<U> )
+    auto operator*() const noexcept -> U&
+    {
+        return *get();
+    }
+    template <class U = T> requires ( !std::is_void_v<U> )
+    auto operator[]( difference_type i ) const noexcept -> U&
+    {
+        return get()[i];
+    }
+    template <class U = T> requires ( !std::is_void_v<U> )
+    static auto pointer_to( U& r ) noexcept -> OffsetPtr
+    {
+        return OffsetPtr{ std::addressof( r ) };
+    }
+
+    auto operator++() noexcept -> OffsetPtr&
+    {
+        offset_ += sizeof( T );
+        return *this;
+    }
+    auto operator++( int ) noexcept -> OffsetPtr
+    {
+        auto tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    auto operator--() noexcept -> OffsetPtr&
+    {
+        offset_ -= sizeof( T );
+        return *this;
+    }
+    auto operator--( int ) noexcept -> OffsetPtr
+    {
+        auto tmp = *this;
+        --*this;
+        return tmp;
+    }
+    auto operator+=( difference_type n ) noexcept -> OffsetPtr&
+    {
+        offset_ += n * static_cast<difference_type>( sizeof( T ) );
+        return *this;
+    }
+    auto operator-=( difference_type n ) noexcept -> OffsetPtr&
+    {
+        offset_ -= n * static_cast<difference_type>( sizeof( T ) );
+        return *this;
+    }
+    friend auto operator+( OffsetPtr p, difference_type n ) noexcept -> OffsetPtr
+    {
+        return p += n;
+    }
+    friend auto operator+( difference_type n, OffsetPtr p ) noexcept -> OffsetPtr
+    {
+        return p += n;
+    }
+    friend auto operator-( OffsetPtr p, difference_type n ) noexcept -> OffsetPtr
+    {
+        return p -= n;
+    }
+    friend auto operator-( const OffsetPtr& a, const OffsetPtr& b ) noexcept -> difference_type
+    {
+        return a.get() - b.get();
+    }
+
+    friend auto operator==( const OffsetPtr& a, const OffsetPtr& b ) noexcept -> bool
+    {
+        return a.get() == b.get();
+    }
+    friend auto operator<=>( const OffsetPtr& a, const OffsetPtr& b ) noexcept
+    {
+        return std::compare_three_way{}( a.get(), b.get() );
+    }
+
+private:
+    static constexpr difference_type null_offset = 1; // 0 would be a pointer to itself
+
+    auto set( T* p ) noexcept -> void
+    {
+        offset_ = p == nullptr ? null_offset
+            : reinterpret_cast<const std::byte*>( p ) - reinterpret_cast<const std::byte*>( this );
+    }
+
+    difference_type offset_{ null_offset };
+};
+
+//-------------------------------------------------------------------------
+
+struct MappedFileOptions
+{
+    size_t initial_size = size_t{ 1 } << 20;
+    size_t max_size = size_t{ 64 } << 30; // Address space reserved for the mapping, the file never grows past it
+    std::uint64_t layout_tag = 0; // Identifies what the program stores in the file, change it when that changes
+    bool recreate_if_incompatible = false; // Discard a heap of another layout or build instead of throwing
+};
+
+class MappedFileResource : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t page_size = 4096;
+
+    explicit MappedFileResource( const std::filesystem::path& path, MappedFileOptions options = {} )
+        : max_size_{ round_up( std::max( options.max_size, sizeof( Header ) ), page_size ) }
+    {
+        open( path, options );
+        const auto layout = layout_fingerprint( options.layout_tag );
+        if ( !created_ && header()->magic_ != magic )
+        {
+            close();
+            throw std::runtime_error{ "MappedFileResource: " + path.string() + " is not a mapped file heap" };
+        }
+        if ( !created_ && ( header()->version_ != version || header()->layout_ != layout ) )
+        {
+            if ( !options.recreate_if_incompatible )
+            {
+                close();
+                throw std::runtime_error{ "MappedFileResource: " + path.string() + " was written with another layout" };
+            }
+            created_ = true; // Its contents are discarded
+        }
+        if ( created_ )
+        {
+            auto* h = ::new ( base_ ) Header{};
+            h->layout_ = layout;
+            h->used_ = round_up( sizeof( Header ), alignof( std::max_align_t ) );
+        }
+        header()->owner_ = this; // Only valid while this is open, it is rewritten at every open
+    }
+    MappedFileResource( const MappedFileResource& ) = delete;
+    MappedFileResource& operator=( const MappedFileResource& ) = delete;
+    ~MappedFileResource()
+    {
+        header()->owner_ = nullptr;
+        close();
+    }
+
+    // Whether the file was created (or was empty, or discarded as incompatible) when it was opened
+    auto created() const noexcept -> bool
+    {
+        return created_;
+    }
+    // Bytes handed out or in the free lists, and bytes mapped (the file size)
+    auto used() const noexcept -> size_t
+    {
+        return static_cast<size_t>( header()->used_ );
+    }
+    auto mapped_size() const noexcept -> size_t
+    {
+        return size_;
+    }
+    auto base() const noexcept -> std::byte*
+    {
+        return base_;
+    }
+
+    // The object everything else in the file is reached from, nullptr in a new file
+    template <class T>
+    auto root() const -> T*
+    {
+        const auto* h = header();
+        if ( h->root_ == 0 )
+        {
+            return nullptr;
+        }
+        if ( h->root_type_ != type_fingerprint<T>() )
+        {
+            throw std::runtime_error{ "MappedFileResource: the root has another type" };
+        }
+        return std::launder( reinterpret_cast<T*>( base_ + h->root_ ) );
+    }
+    template <class T, class... Args>
+    auto construct_root( Args&&... args ) -> T&
+    {
+        auto* p = allocate( sizeof( T ), alignof( T ) );
+        auto* root = ::new ( p ) T( std::forward<Args>( args )... );
+        header()->root_ = static_cast<std::uint64_t>( static_cast<std::byte*>( p ) - base_ );
+        header()->root_type_ = type_fingerprint<T>();
+        return *root;
+    }
+
+    // Writes the dirty pages to the file now instead of whenever the OS gets to it
+    auto flush() -> void
+    {
+#if defined(_WIN32)
+        if ( !::FlushViewOfFile( base_, size_ ) || !::FlushFileBuffers( file_ ) )
+        {
+            throw std::system_error{ static_cast<int>( ::GetLastError() ), std::system_category(), "FlushViewOfFile" };
+        }
+#else
+        if ( ::msync( base_, size_, MS_SYNC ) != 0 )
+        {
+            throw std::system_error{ errno, std::generic_category(), "msync" };
+        }
+#endif
+    }
+
+    // The resource that has the file mapped at base open, for MappedFileAllocator
+    static auto owner_of_base( const void* base ) noexcept -> MappedFileResource*
+    {
+        return static_cast<const Header*>( base )->owner_;
+    }
+
+private:
+    static constexpr std::uint64_t magic = 0x5041'4548'4550'4D48; // The first bytes of the file read "HMPEHEAP"
+    static constexpr std::uint64_t version = 2;
+    static constexpr size_t class_count = 48; // Blocks of 16 B (class 4) to 128 TiB
+
+    struct Header
+    {
+        std::uint64_t magic_ = magic;
+        std::uint64_t version_ = version;
+        std::uint64_t used_ = 0;          // End of the carved out blocks
+        std::uint64_t root_ = 0;          // Offset of the root object, 0 if none
+        std::uint64_t root_type_ = 0;     // type_fingerprint() of the root
+        std::uint64_t layout_ = 0;        // layout_fingerprint() of the build that created the file
+        MappedFileResource* owner_ = nullptr;
+        std::uint64_t free_[class_count]{}; // Offsets of the first free block of each size, linked through their first word
+    };
+
+    static constexpr auto round_up( size_t n, size_t align ) noexcept -> size_t
+    {
+        return ( n + align - 1 ) & ~( align - 1 );
+    }
+
+    // FNV-1a
+    static constexpr auto hash( std::uint64_t h, std::uint64_t value ) noexcept -> std::uint64_t
+    {
+        for ( auto i = 0; i < 8; ++i )
+        {
+            h = ( h ^ ( ( value >> ( i * 8 ) ) & 0xff ) ) * 0x100'0000'01B3;
+        }
+        return h;
+    }
+    static constexpr auto hash( std::uint64_t h, std::string_view s ) noexcept -> std::uint64_t
+    {
+        for ( auto c : s )
+        {
+            h = ( h ^ static_cast<unsigned char>( c ) ) * 0x100'0000'01B3;
+        }
+        return h;
+    }
+
+    // What decides the layout of the standard containers stored in the file
+    static constexpr auto layout_fingerprint( std::uint64_t layout_tag ) noexcept -> std::uint64_t
+    {
+        auto h = hash( 0xCBF2'9CE4'8422'2325, layout_tag );
+        h = hash( h, sizeof( void* ) );
+#if defined(_MSC_FULL_VER)
+        h = hash( h, std::uint64_t{ _MSC_FULL_VER } );
+#endif
+#if defined(_ITERATOR_DEBUG_LEVEL)
+        h = hash( h, std::uint64_t{ _ITERATOR_DEBUG_LEVEL } );
+#endif
+#if defined(__VERSION__)
+        h = hash( h, std::string_view{ __VERSION__ } );
+#endif
+#if defined(__GLIBCXX__)
+        h = hash( h, std::uint64_t{ __GLIBCXX__ } );
+#endif
+#if defined(_GLIBCXX_DEBUG)
+        h = hash( h, std::uint64_t{ 1 } );
+#endif
+#if defined(_LIBCPP_VERSION)
+        h = hash( h, std::uint64_t{ _LIBCPP_VERSION } );
+#endif
+        return h;
+    }
+
+    template <class T>
+    static auto type_fingerprint() noexcept -> std::uint64_t
+    {
+        return hash( hash( 0xCBF2'9CE4'8422'2325, std::string_view{ typeid( T ).name() } ), sizeof( T ) );
+    }
+
+    auto header() const noexcept -> Header*
+    {
+        return std::launder( reinterpret_cast<Header*>( base_ ) );
+    }
+
+    static auto block_size( size_t bytes, size_t align ) noexcept -> size_t
+    {
+        return std::max( std::bit_ceil( std::max( bytes, size_t{ 16 } ) ), align );
+    }
+
+    auto do_allocate( size_t bytes, size_t align ) -> void* override
+    {
+        if ( align > page_size || bytes > max_size_ )
+        {
+            throw std::bad_alloc{};
+        }
+        const auto size = block_size( bytes, align );
+        const auto cls = static_cast<size_t>( std::countr_zero( size ) );
+        auto* h = header();
+        if ( const auto offset = h->free_[cls]; offset != 0 )
+        {
+            h->free_[cls] = *reinterpret_cast<std::uint64_t*>( base_ + offset );
+            return base_ + offset;
+        }
+        // Blocks are aligned to their size (up to a page), so a reused block satisfies any alignment its size class allows
+        const auto offset = round_up( static_cast<size_t>( h->used_ ), std::min( size, page_size ) );
+        if ( offset + size > size_ )
+        {
+            grow( offset + size );
+            h = header();
+        }
+        h->used_ = offset + size;
+        return base_ + offset;
+    }
+
+    auto do_deallocate( void* p, size_t bytes, size_t align ) -> void override
+    {
+        const auto cls = static_cast<size_t>( std::countr_zero( block_size( bytes, align ) ) );
+        const auto offset = static_cast<std::uint64_t>( static_cast<std::byte*>( p ) - base_ );
+        auto* h = header();
+        *reinterpret_cast<std::uint64_t*>( p ) = h->free_[cls];
+        h->free_[cls] = offset;
+    }
+
+    auto do_is_equal( const std::pmr::memory_resource& other ) const noexcept -> bool override
+    {
+        return this == &other;
+    }
+
+    auto grow( size_t min_size ) -> void
+    {
+        if ( min_size > max_size_ )
+        {
+            throw std::bad_alloc{};
+        }
+        const auto new_size = std::min( std::max( round_up( min_size, page_size ), size_ * 2 ), max_size_ );
+        map( new_size );
+    }
+
+#if defined(_WIN32)
+    auto open( const std::filesystem::path& path, const MappedFileOptions& options ) -> void
+    {
+        file_ = ::CreateFileW( path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+        if ( file_ == INVALID_HANDLE_VALUE )
+        {
+            throw std::system_error{ static_cast<int>( ::GetLastError() ), std::system_category(), "CreateFile " + path.string() };
+        }
+        auto file_size = LARGE_INTEGER{};
+        ::GetFileSizeEx( file_, &file_size );
+        created_ = file_size.QuadPart == 0;
+        const auto size = created_ ? round_up( std::max( options.initial_size, sizeof( Header ) ), page_size ) : static_cast<size_t>( file_size.QuadPart );
+        try
+        {
+            map( std::min( size, max_size_ ) );
+        }
+        catch ( ... )
+        {
+            ::CloseHandle( file_ );
+            throw;
+        }
+    }
+
+    // Creating a bigger mapping object extends the file
+    auto map( size_t size ) -> void
+    {
+        auto* const old_base = base_;
+        if ( base_ != nullptr )
+        {
+            ::UnmapViewOfFile( base_ );
+            ::CloseHandle( mapping_ );
+        }
+        mapping_ = ::CreateFileMappingW( file_, nullptr, PAGE_READWRITE, static_cast<DWORD>( std::uint64_t{ size } >> 32 ),
+                                         static_cast<DWORD>( size ), nullptr );
+        base_ = mapping_ != nullptr
+            ? static_cast<std::byte*>( ::MapViewOfFileEx( mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size, old_base ) )
+            : nullptr;
+        if ( base_ == nullptr )
+        {
+            base_ = old_base;
+            if ( old_base != nullptr )
+            {
+                // Try to get the old view back at its address, the containers in it can't move
+                mapping_ = ::CreateFileMappingW( file_, nullptr, PAGE_READWRITE, 0, 0, nullptr );
+                ::MapViewOfFileEx( mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size_, old_base );
+            }
+            throw std::bad_alloc{};
+        }
+        size_ = size;
+    }
+
+    auto close() noexcept -> void
+    {
+        ::UnmapViewOfFile( base_ );
+        ::CloseHandle( mapping_ );
+        ::CloseHandle( file_ );
+    }
+
+    HANDLE file_{ INVALID_HANDLE_VALUE };
+    HANDLE mapping_{ nullptr };
+#else
+    auto open( const std::filesystem::path& path, const MappedFileOptions& options ) -> void
+    {
+        fd_ = ::open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+        if ( fd_ < 0 )
+        {
+            throw std::system_error{ errno, std::generic_category(), "open " + path.string() };
+        }
+        struct stat st{};
+        ::fstat( fd_, &st );
+        created_ = st.st_size == 0;
+        const auto size = created_ ? round_up( std::max( options.initial_size, sizeof( Header ) ), page_size ) : static_cast<size_t>( st.st_size );
+
+        // Reserve the address range once, the file is mapped over its beginning
+        auto* reserved = ::mmap( nullptr, max_size_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+        if ( reserved == MAP_FAILED )
+        {
+            ::close( fd_ );
+            throw std::bad_alloc{};
+        }
+        base_ = static_cast<std::byte*>( reserved );
+        try
+        {
+            map( std::min( size, max_size_ ) );
+        }
+        catch ( ... )
+        {
+            ::munmap( base_, max_size_ );
+            ::close( fd_ );
+            throw;
+        }
+    }
+
+    auto map( size_t size ) -> void
+    {
+        if ( size > size_ && ::ftruncate( fd_, static_cast<off_t>( size ) ) != 0 )
+        {
+            throw std::system_error{ errno, std::generic_category(), "ftruncate" };
+        }
+        if ( ::mmap( base_, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd_, 0 ) == MAP_FAILED )
+        {
+            throw std::system_error{ errno, std::generic_category(), "mmap" };
+        }
+        size_ = size;
+    }
+
+    auto close() noexcept -> void
+    {
+        ::munmap( base_, max_size_ );
+        ::close( fd_ );
+    }
+
+    int fd_{ -1 };
+#endif
+
+    size_t max_size_;
+    std::byte* base_{ nullptr };
+    size_t size_{ 0 };
+    bool created_{ false };
+};
+
+//-------------------------------------------------------------------------
+
+// A standard allocator taking its memory from a MappedFileResource, with OffsetPtr as its pointer type.
+// It refers to the file by an OffsetPtr to its start, so it can live in the file itself (inside a container).
+template <class T>
+class MappedFileAllocator
+{
+public:
+    using value_type = T;
+    using pointer = OffsetPtr<T>;
+    using const_pointer = OffsetPtr<const T>;
+    using void_pointer = OffsetPtr<void>;
+    using const_void_pointer = OffsetPtr<const void>;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+
+    explicit MappedFileAllocator( MappedFileResource& resource ) noexcept : base_{ resource.base() }
+    {}
+    template <class U>
+    MappedFileAllocator( const MappedFileAllocator<U>& other ) noexcept : base_{ other.base_ }
+    {}
+
+    auto allocate( size_t n ) -> pointer
+    {
+        if ( n > std::numeric_limits<size_t>::max() / sizeof( T ) )
+        {
+            throw std::bad_array_new_length{};
+        }
+        return pointer{ static_cast<T*>( resource()->allocate( n * sizeof( T ), alignof( T ) ) ) };
+    }
+    auto deallocate( pointer p, size_t n ) noexcept -> void
+    {
+        resource()->deallocate( p.get(), n * sizeof( T ), alignof( T ) );
+    }
+
+    auto resource() const noexcept -> MappedFileResource*
+    {
+        return MappedFileResource::owner_of_base( base_.get() );
+    }
+
+    template <class U>
+    auto operator==( const MappedFileAllocator<U>& other ) const noexcept
+    {
+        return base_.get() == other.base_.get();
+    }
+
+    template <class U> friend class MappedFileAllocator;
+private:
+    OffsetPtr<std::byte> base_;
+};
+
+template <class T>
+using PersistentVector = std::vector<T, MappedFileAllocator<T>>;
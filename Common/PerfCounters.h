@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware performance counters (PMC) of the calling thread, read through perf_event_open on Linux.
+//
+// Wall time only tells us that something is slow, the counters tell us why:
+// a low IPC with many L1D/LLC misses is memory bound (e.g. cache thrashing),
+// many dTLB misses points to strided access over many pages,
+// and many branch misses to unpredictable control flow.
+//
+// Each counter is opened on its own (not as a group), so a counter the CPU or the VM
+// doesn't support is simply reported as unavailable. If perf_event_open is not permitted
+// (see /proc/sys/kernel/perf_event_paranoid) or on other platforms, only wall time is reported.
+
+enum class PerfCounter : size_t
+{
+    Cycles,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    BranchMisses,
+    DTLBMisses,
+    Count
+};
+
+struct PerfCounterValues
+{
+    std::array<std::optional<std::uint64_t>, static_cast<size_t>( PerfCounter::Count )> values_{};
+    std::chrono::nanoseconds wall_time_{};
+
+    auto operator[]( PerfCounter c ) const -> const std::optional<std::uint64_t>&
+    {
+        return values_[static_cast<size_t>( c )];
+    }
+    auto ipc() const -> std::optional<double>
+    {
+        const auto& cycles = ( *this )[PerfCounter::Cycles];
+        const auto& instructions = ( *this )[PerfCounter::Instructions];
+        if ( !cycles || !instructions || *cycles == 0 )
+        {
+            return std::nullopt;
+        }
+        return static_cast<double>( *instructions ) / static_cast<double>( *cycles );
+    }
+};
+
+class PerfCounters
+{
+public:
+    using ClockType = std::chrono::steady_clock;
+
+    PerfCounters()
+    {
+#if defined(__linux__)
+        constexpr auto cache_event = [] ( std::uint64_t cache, std::uint64_t result )
+        {
+            return cache | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( result << 16 );
+        };
+        const std::pair<std::uint32_t, std::uint64_t> events[] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HW_CACHE, cache_event( PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS ) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }, // Last level cache
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { PERF_TYPE_HW_CACHE, cache_event( PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS ) },
+        };
+        static_assert( std::size( events ) == static_cast<size_t>( PerfCounter::Count ) );
+
+        for ( auto i = size_t{ 0 }; i < fds_.size(); ++i )
+        {
+            auto attr = perf_event_attr{};
+            attr.size = sizeof( attr );
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // Counters get multiplexed when there are more events than hardware registers, read the
+            // enabled/running times so the value can be scaled
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds_[i] = static_cast<int>( syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+        }
+#endif
+    }
+    PerfCounters( const PerfCounters& ) = delete;
+    PerfCounters& operator=( const PerfCounters& ) = delete;
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for ( auto fd : fds_ )
+        {
+            if ( fd >= 0 )
+            {
+                close( fd );
+            }
+        }
+#endif
+    }
+
+    // True if at least one hardware counter could be opened
+    auto available() const noexcept -> bool
+    {
+        for ( auto fd : fds_ )
+        {
+            if ( fd >= 0 )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    auto start() noexcept -> void
+    {
+#if defined(__linux__)
+        for ( auto fd : fds_ )
+        {
+            if ( fd >= 0 )
+            {
+                ioctl( fd, PERF_EVENT_IOC_RESET, 0 );
+                ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+            }
+        }
+#endif
+        start_ = ClockType::now();
+    }
+
+    auto stop() noexcept -> PerfCounterValues
+    {
+        auto result = PerfCounterValues{};
+        result.wall_time_ = ClockType::now() - start_;
+#if defined(__linux__)
+        for ( auto fd : fds_ )
+        {
+            if ( fd >= 0 )
+            {
+                ioctl( fd, PERF_EVENT_IOC_DISABLE, 0 );
+            }
+        }
+        for ( auto i = size_t{ 0 }; i < fds_.size(); ++i )
+        {
+            struct
+            {
+                std::uint64_t value_;
+                std::uint64_t time_enabled_;
+                std::uint64_t time_running_;
+            } data{};
+            if ( fds_[i] < 0 || read( fds_[i], &data, sizeof( data ) ) != sizeof( data ) || data.time_running_ == 0 )
+            {
+                continue;
+            }
+            const auto scale = static_cast<double>( data.time_enabled_ ) / static_cast<double>( data.time_running_ );
+            result.values_[i] = static_cast<std::uint64_t>( static_cast<double>( data.value_ ) * scale );
+        }
+#endif
+        return result;
+    }
+
+private:
+    std::array<int, static_cast<size_t>( PerfCounter::Count )> fds_{ -1, -1, -1, -1, -1, -1 };
+    ClockType::time_point start_{};
+};
+
+inline auto print_perf_counters( std::ostream& os, const char* name, const PerfCounterValues& v ) -> void
+{
+    using namespace std::chrono;
+    os << duration_cast<microseconds>( v.wall_time_ ).count() << " us " << name << '\n';
+    if ( std::none_of( v.values_.begin(), v.values_.end(), [] ( const auto& value ) { return value.has_value(); } ) )
+    {
+        os << "    (hardware counters unavailable, wall time only)\n";
+        return;
+    }
+
+    const auto print = [ & ] ( const char* label, const std::optional<std::uint64_t>& value )
+    {
+        if ( value )
+        {
+            os << "    " << label << *value << '\n';
+        }
+    };
+    print( "cycles:        ", v[PerfCounter::Cycles] );
+    print( "instructions:  ", v[PerfCounter::Instructions] );
+    if ( const auto ipc = v.ipc() )
+    {
+        char buf[16];
+        std::snprintf( buf, sizeof( buf ), "%.2f", *ipc );
+        os << "    IPC:           " << buf << '\n';
+    }
+    print( "L1D misses:    ", v[PerfCounter::L1DMisses] );
+    print( "LLC misses:    ", v[PerfCounter::LLCMisses] );
+    print( "branch misses: ", v[PerfCounter::BranchMisses] );
+    print( "dTLB misses:   ", v[PerfCounter::DTLBMisses] );
+}
+
+// Like ScopedTimer, but also reports the hardware counters of the scope.
+// Falls back to wall time when the counters are unavailable.
+class ScopedPerfCounters
+{
+public:
+    explicit ScopedPerfCounters( const char* name ) : name_{ name }
+    {
+        counters_.start();
+    }
+    ScopedPerfCounters( const ScopedPerfCounters& ) = delete;
+    ScopedPerfCounters& operator=( const ScopedPerfCounters& ) = delete;
+    ~ScopedPerfCounters()
+    {
+        const auto values = counters_.stop();
+        print_perf_counters( std::cout, name_, values );
+    }
+private:
+    const char* name_{};
+    PerfCounters counters_{};
+};
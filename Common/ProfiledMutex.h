@@ -0,0 +1,222 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include "TscClock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A drop-in mutex wrapper that tells how much a lock is fought over.
+//
+// ProfiledMutex satisfies Lockable, so it works with std::scoped_lock, std::unique_lock,
+// std::lock() and std::condition_variable_any. Every named lock gets:
+// - the number of acquisitions, and how many of them had to wait (contended),
+// - a histogram of the time spent waiting for the lock,
+// - a histogram of the time the lock was held.
+// Each mutex keeps statistics of its own, so the statistics of distinct mutexes never share a cache line.
+// At exit (or on print_all()) the locks are summed by name, with those of destroyed mutexes of that name:
+// every BoundedBuffer's m_ shows up as one "BoundedBuffer::m_" line.
+//
+// The uncontended path is a try_lock() plus two TSC reads. The statistics are updated while
+// the lock is still held, so the mutex itself serializes them and they add no contention of their own.
+
+class LockStats
+{
+public:
+    explicit LockStats( std::string name ) : name_{ std::move( name ) }
+    {}
+    LockStats( const LockStats& ) = delete;
+    LockStats& operator=( const LockStats& ) = delete;
+
+    auto name() const noexcept -> const std::string&
+    {
+        return name_;
+    }
+    auto acquisitions() const noexcept -> std::uint64_t
+    {
+        return acquisitions_.load( std::memory_order_relaxed );
+    }
+    auto contended() const noexcept -> std::uint64_t
+    {
+        return contended_.load( std::memory_order_relaxed );
+    }
+    auto wait_time() const noexcept -> const LatencyHistogram&
+    {
+        return wait_time_;
+    }
+    auto hold_time() const noexcept -> const LatencyHistogram&
+    {
+        return hold_time_;
+    }
+
+    auto print( std::ostream& os ) const -> void
+    {
+        const auto acquisitions = this->acquisitions();
+        if ( acquisitions == 0 )
+        {
+            return;
+        }
+        const auto contended = this->contended();
+        char buf[96];
+        std::snprintf( buf, sizeof( buf ), "%llu acquisitions, %llu contended (%.1f%%)",
+                       static_cast<unsigned long long>( acquisitions ), static_cast<unsigned long long>( contended ),
+                       100.0 * static_cast<double>( contended ) / static_cast<double>( acquisitions ) );
+        os << name_ << ": " << buf << '\n';
+        if ( contended != 0 )
+        {
+            wait_time_.print( os, "  wait" );
+        }
+        hold_time_.print( os, "  hold" );
+    }
+
+    auto merge( const LockStats& other ) noexcept -> void
+    {
+        acquisitions_.fetch_add( other.acquisitions(), std::memory_order_relaxed );
+        contended_.fetch_add( other.contended(), std::memory_order_relaxed );
+        wait_time_.merge( other.wait_time_ );
+        hold_time_.merge( other.hold_time_ );
+    }
+
+    // Prints every lock that has been taken, summed by name, also done automatically at exit
+    static auto print_all( std::ostream& os ) -> void
+    {
+        registry().print( os );
+    }
+
+private:
+    template <class Mutex>
+    friend class BasicProfiledMutex;
+
+    class Registry
+    {
+    public:
+        ~Registry()
+        {
+            print( std::cout );
+        }
+        auto add( const LockStats* stats ) -> void
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            live_.push_back( stats );
+        }
+        // The statistics of a destroyed mutex are kept in the totals of its name
+        auto remove( const LockStats* stats ) -> void
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            live_.erase( std::find( live_.begin(), live_.end(), stats ) );
+            retired_.try_emplace( stats->name(), stats->name() ).first->second.merge( *stats );
+        }
+        auto print( std::ostream& os ) -> void
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            auto totals = std::map<std::string, LockStats>{};
+            for ( const auto& [name, stats] : retired_ )
+            {
+                totals.try_emplace( name, name ).first->second.merge( stats );
+            }
+            for ( const auto* stats : live_ )
+            {
+                totals.try_emplace( stats->name(), stats->name() ).first->second.merge( *stats );
+            }
+            if ( totals.empty() )
+            {
+                return;
+            }
+            os << "\n-- lock contention --\n";
+            for ( const auto& [name, stats] : totals )
+            {
+                stats.print( os );
+            }
+        }
+    private:
+        std::mutex mutex_;
+        std::vector<const LockStats*> live_;
+        std::map<std::string, LockStats> retired_;
+    };
+
+    static auto registry() -> Registry&
+    {
+        static auto r = Registry{};
+        return r;
+    }
+
+    std::string name_;
+    std::atomic<std::uint64_t> acquisitions_{ 0 };
+    std::atomic<std::uint64_t> contended_{ 0 };
+    LatencyHistogram wait_time_;
+    LatencyHistogram hold_time_;
+};
+
+template <class Mutex>
+class BasicProfiledMutex
+{
+public:
+    explicit BasicProfiledMutex( const char* name ) : stats_{ name }
+    {
+        LockStats::registry().add( &stats_ );
+    }
+    ~BasicProfiledMutex()
+    {
+        LockStats::registry().remove( &stats_ );
+    }
+    BasicProfiledMutex( const BasicProfiledMutex& ) = delete;
+    BasicProfiledMutex& operator=( const BasicProfiledMutex& ) = delete;
+
+    auto lock() -> void
+    {
+        if ( mutex_.try_lock() )
+        {
+            acquired( TscClock::now() );
+            return;
+        }
+        const auto start = TscClock::now();
+        mutex_.lock();
+        const auto now = TscClock::now();
+        stats_.contended_.fetch_add( 1, std::memory_order_relaxed );
+        stats_.wait_time_.record( static_cast<std::uint64_t>( TscClock::to_ns( now - start ) ) );
+        acquired( now );
+    }
+
+    auto try_lock() -> bool
+    {
+        if ( !mutex_.try_lock() )
+        {
+            return false;
+        }
+        acquired( TscClock::now() );
+        return true;
+    }
+
+    auto unlock() -> void
+    {
+        // Still holding the lock, so only one thread at a time touches this mutex's statistics
+        stats_.hold_time_.record( static_cast<std::uint64_t>( TscClock::to_ns( TscClock::now() - hold_start_ ) ) );
+        mutex_.unlock();
+    }
+
+    // This mutex alone
+    auto stats() const noexcept -> const LockStats&
+    {
+        return stats_;
+    }
+
+private:
+    auto acquired( std::uint64_t now ) noexcept -> void
+    {
+        hold_start_ = now;
+        stats_.acquisitions_.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    Mutex mutex_;
+    LockStats stats_;
+    std::uint64_t hold_start_{}; // Only written by the owner
+};
+
+using ProfiledMutex = BasicProfiledMutex<std::mutex>;
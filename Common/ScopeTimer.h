@@ -2,14 +2,23 @@
 
 #include <chrono>
 #include <iostream>
+#include <source_location>
+
+#include "TraceProfiler.h"
+#include "TscClock.h"
 
 // This is an instruction profiler
+// When a trace session is active (see TraceProfiler.h), the timer records begin/end events
+// into the per-thread trace buffer instead of printing, so nesting and threads are preserved.
 class ScopedTimer
 {
 public:
     using ClockType = std::chrono::steady_clock;
     ScopedTimer( const char* func )
-        : function_name_{ func }, start_{ ClockType::now() }
+        : function_name_{ func },
+          traced_{ TraceProfiler::is_active() },
+          recorded_{ traced_ && TraceProfiler::begin_event( func ) },
+          start_{ ClockType::now() }
     {}
     ScopedTimer( const ScopedTimer& ) = delete;
     ScopedTimer( ScopedTimer&& ) = delete;
@@ -17,6 +26,15 @@ public:
     auto operator=( ScopedTimer&& )->ScopedTimer & = delete;
     inline ~ScopedTimer()
     {
+        if ( traced_ )
+        {
+            if ( recorded_ )
+            {
+                TraceProfiler::end_event( function_name_ );
+            }
+            return;
+        }
+
         using namespace std::chrono;
         auto stop = ClockType::now();
         auto duration = ( stop - start_ );
@@ -26,5 +44,27 @@ public:
 
 private:
     const char* function_name_{};
+    const bool traced_{};
+    const bool recorded_{};
     const ClockType::time_point start_{};
-};
\ No newline at end of file
+};
+
+#ifndef USE_TIMER
+#define USE_TIMER 1
+#endif
+
+// Define USE_TSC_TIMER to 1 before including this header to make MEASURE_FUNCTION() accumulate
+// per call site cycle counts instead (see TscClock.h), for functions too short for microseconds.
+#ifndef USE_TSC_TIMER
+#define USE_TSC_TIMER 0
+#endif
+
+#if USE_TIMER && USE_TSC_TIMER
+#define MEASURE_FUNCTION() \
+    static auto& __tsc_site = TscCallSite::get( std::source_location::current().function_name() ); \
+    ScopedTscTimer __timer{ __tsc_site }
+#elif USE_TIMER
+#define MEASURE_FUNCTION() ScopedTimer __timer{ std::source_location::current().function_name() } 
+#else 
+#define MEASURE_FUNCTION() 
+#endif
\ No newline at end of file
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+// A per-thread scratch arena for short-lived temporaries.
+//
+// Request processing allocates many temporaries (split strings, intermediate vectors...)
+// that all die before the request ends. Instead of going through malloc for each of them,
+// they are bumped out of a thread-local arena, and a ScratchFrame rolls the bump pointer back
+// to where it was when the frame was opened. Allocation is a pointer increment, and freeing
+// a whole request worth of temporaries is O(1).
+//
+//     {
+//         auto frame = ScratchFrame{};
+//         auto parts = std::pmr::vector<std::pmr::string>{ frame.resource() };
+//         auto values = std::vector<double, ScratchAllocator<double>>{};
+//         ...
+//     } // Everything allocated above is released here
+//
+// Frames nest, and must be closed in reverse order (which RAII guarantees).
+// Nothing allocated inside a frame may outlive it. Each thread has its own arena, so there
+// is no locking, but scratch memory must not be handed over to another thread either.
+
+class ScratchArena : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t first_block_size = size_t{ 64 } << 10;
+
+    // A position in the arena, see ScratchFrame
+    struct Mark
+    {
+        void* block_{};
+        std::byte* ptr_{};
+        size_t used_in_previous_blocks_{};
+    };
+
+    // The arena of the calling thread
+    static auto current() -> ScratchArena&
+    {
+        static thread_local auto arena = ScratchArena{};
+        return arena;
+    }
+
+    ScratchArena() = default;
+    ScratchArena( ScratchArena&& ) = delete;
+    ScratchArena& operator=( ScratchArena&& ) = delete;
+    ~ScratchArena()
+    {
+        while ( first_ != nullptr )
+        {
+            auto* next = first_->next_;
+            ::operator delete( first_, sizeof( Block ) + first_->size_ );
+            first_ = next;
+        }
+    }
+
+    auto mark() const noexcept -> Mark
+    {
+        return Mark{ current_, ptr_, used_in_previous_blocks_ };
+    }
+    // Releases everything allocated since the mark was taken, the blocks are kept for reuse
+    auto rewind( const Mark& m ) noexcept -> void
+    {
+        current_ = static_cast<Block*>( m.block_ );
+        ptr_ = m.ptr_;
+        end_ = current_ != nullptr ? current_->data() + current_->size_ : nullptr;
+        used_in_previous_blocks_ = m.used_in_previous_blocks_;
+    }
+
+    auto used() const noexcept -> size_t
+    {
+        return used_in_previous_blocks_ + ( current_ != nullptr ? static_cast<size_t>( ptr_ - current_->data() ) : 0 );
+    }
+    auto capacity() const noexcept -> size_t
+    {
+        return capacity_;
+    }
+    auto high_water_mark() const noexcept -> size_t
+    {
+        return high_water_mark_;
+    }
+
+private:
+    struct alignas( std::max_align_t ) Block
+    {
+        Block* next_{};
+        size_t size_{};
+        auto data() noexcept -> std::byte*
+        {
+            return reinterpret_cast<std::byte*>( this + 1 );
+        }
+    };
+
+    static auto align_up( std::uintptr_t n, size_t align ) noexcept -> std::uintptr_t
+    {
+        return ( n + ( align - 1 ) ) & ~static_cast<std::uintptr_t>( align - 1 );
+    }
+
+    auto do_allocate( size_t bytes, size_t align ) -> void* override
+    {
+        auto* p = reinterpret_cast<std::byte*>( align_up( reinterpret_cast<std::uintptr_t>( ptr_ ), align ) );
+        if ( ptr_ == nullptr || p > end_ || static_cast<size_t>( end_ - p ) < bytes )
+        {
+            next_block( bytes + ( align > alignof( std::max_align_t ) ? align : 0 ) );
+            p = reinterpret_cast<std::byte*>( align_up( reinterpret_cast<std::uintptr_t>( ptr_ ), align ) );
+        }
+        ptr_ = p + bytes;
+        high_water_mark_ = std::max( high_water_mark_, used() );
+        return p;
+    }
+
+    auto do_deallocate( void* p, size_t bytes, size_t ) -> void override
+    {
+        // Only the latest allocation is given back (e.g. a vector growing), the rest waits for the frame
+        auto* b = static_cast<std::byte*>( p );
+        if ( current_ != nullptr && b >= current_->data() && b + bytes == ptr_ )
+        {
+            ptr_ = b;
+        }
+    }
+
+    auto do_is_equal( const std::pmr::memory_resource& other ) const noexcept -> bool override
+    {
+        return this == &other;
+    }
+
+    auto next_block( size_t needed ) -> void
+    {
+        if ( current_ != nullptr )
+        {
+            used_in_previous_blocks_ += current_->size_;
+        }
+        // Reuse the blocks left behind by a rewind first
+        auto* next = current_ != nullptr ? current_->next_ : first_;
+        if ( next == nullptr || next->size_ < needed )
+        {
+            const auto size = std::max( std::max( capacity_, first_block_size ), needed );
+            next = ::new ( ::operator new( sizeof( Block ) + size ) ) Block{ next, size };
+            ( current_ != nullptr ? current_->next_ : first_ ) = next;
+            capacity_ += size;
+        }
+        current_ = next;
+        ptr_ = next->data();
+        end_ = ptr_ + next->size_;
+    }
+
+    Block* first_{ nullptr };
+    Block* current_{ nullptr };
+    std::byte* ptr_{ nullptr };
+    std::byte* end_{ nullptr };
+    size_t used_in_previous_blocks_{ 0 };
+    size_t capacity_{ 0 };
+    size_t high_water_mark_{ 0 };
+};
+
+// RAII mark on the thread's scratch arena
+class ScratchFrame
+{
+public:
+    ScratchFrame() noexcept : arena_{ ScratchArena::current() }, mark_{ arena_.mark() }
+    {}
+    ScratchFrame( const ScratchFrame& ) = delete;
+    ScratchFrame& operator=( const ScratchFrame& ) = delete;
+    ~ScratchFrame()
+    {
+        arena_.rewind( mark_ );
+    }
+
+    auto resource() noexcept -> std::pmr::memory_resource*
+    {
+        return &arena_;
+    }
+
+private:
+    ScratchArena& arena_;
+    const ScratchArena::Mark mark_;
+};
+
+// A standard allocator on top of the scratch arena of the thread that creates it
+template <class T>
+struct ScratchAllocator
+{
+    using value_type = T;
+
+    ScratchAllocator() noexcept : arena_{ &ScratchArena::current() }
+    {}
+    template <class U>
+    ScratchAllocator( const ScratchAllocator<U>& other ) noexcept : arena_{ other.arena_ }
+    {}
+
+    auto allocate( size_t n ) -> T*
+    {
+        if ( n > std::numeric_limits<size_t>::max() / sizeof( T ) )
+        {
+            throw std::bad_array_new_length{};
+        }
+        return static_cast<T*>( arena_->allocate( n * sizeof( T ), alignof( T ) ) );
+    }
+    auto deallocate( T* p, size_t n ) noexcept -> void
+    {
+        arena_->deallocate( p, n * sizeof( T ), alignof( T ) );
+    }
+
+    template <class U>
+    auto operator==( const ScratchAllocator<U>& other ) const noexcept
+    {
+        return arena_ == other.arena_;
+    }
+
+    template <class U> friend struct ScratchAllocator;
+private:
+    ScratchArena* arena_;
+};
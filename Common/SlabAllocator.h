@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// A size-class slab allocator for fixed-size objects.
+//
+// A class-level operator new on top of an arena can only reclaim memory freed in LIFO order,
+// objects created and destroyed in any other order leak arena space. Here every size class
+// (object sizes rounded up to 16 bytes) owns slabs of 64 KiB carved into equal slots, and freed
+// slots go to an intrusive freelist, so any free order is fine and memory is reused right away.
+//
+// - Each thread keeps a freelist cache per size class, allocate() and deallocate() only touch it.
+// - When its cache is empty, a thread takes a whole batch of slots from the shared depot,
+//   and when it holds more than two batches it returns one. The depot lock is taken once per batch.
+// - A thread that exits gives all its cached slots back to the depot.
+//
+// Slabs are never returned to the system while the program runs, like most malloc arenas do.
+// Use it through the PoolAllocated<T> mixin:
+//
+//     class Node : public PoolAllocated<Node> { ... };
+//     auto* n = new Node{};   // From the slab pool of Node's size class
+//     delete n;
+
+namespace detail
+{
+    struct FreeSlot
+    {
+        FreeSlot* next_;
+    };
+
+    constexpr auto slab_size_class( size_t size ) noexcept -> size_t
+    {
+        return std::max( ( size + 15 ) & ~size_t{ 15 }, sizeof( FreeSlot ) );
+    }
+}
+
+template <size_t Size, size_t Align>
+class SlabPool
+{
+public:
+    static constexpr size_t slot_size = ( Size + Align - 1 ) / Align * Align;
+    static constexpr size_t slab_size = std::max<size_t>( size_t{ 64 } << 10, slot_size * 64 );
+    static constexpr size_t slots_per_slab = slab_size / slot_size;
+    // Enough to amortize the depot lock, small enough not to strand much memory in idle threads
+    static constexpr size_t batch_size = std::clamp<size_t>( ( size_t{ 4 } << 10 ) / slot_size, 8, 64 );
+
+    static_assert( Size >= sizeof( detail::FreeSlot ) && Align >= alignof( detail::FreeSlot ) );
+
+    static auto allocate() -> void*
+    {
+        auto& cache = thread_cache();
+        if ( cache.head_ == nullptr )
+        {
+            const auto batch = depot().pop();
+            cache.head_ = batch.head_;
+            cache.count_ = batch.count_;
+        }
+        auto* slot = cache.head_;
+        cache.head_ = slot->next_;
+        --cache.count_;
+        return slot;
+    }
+
+    static auto deallocate( void* p ) noexcept -> void
+    {
+        auto& cache = thread_cache();
+        cache.head_ = ::new ( p ) detail::FreeSlot{ cache.head_ };
+        if ( ++cache.count_ >= 2 * batch_size )
+        {
+            // Keep one batch for the next allocations, give back the other
+            auto* last = cache.head_;
+            for ( auto i = size_t{ 1 }; i < batch_size; ++i )
+            {
+                last = last->next_;
+            }
+            auto* batch = std::exchange( cache.head_, std::exchange( last->next_, nullptr ) );
+            cache.count_ -= batch_size;
+            depot().push( Batch{ batch, batch_size } ); // Only once it is cut off the thread's list
+        }
+    }
+
+    // Bytes taken from the system by this size class
+    static auto reserved() -> size_t
+    {
+        return depot().slab_count() * slab_size;
+    }
+
+private:
+    struct Batch
+    {
+        detail::FreeSlot* head_{};
+        size_t count_{};
+    };
+
+    // Shared by all threads, holds free slots in whole batches
+    class Depot
+    {
+    public:
+        ~Depot()
+        {
+            for ( auto* slab : slabs_ )
+            {
+                ::operator delete( slab, std::align_val_t{ Align } );
+            }
+        }
+
+        auto pop() -> Batch
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            if ( batches_.empty() )
+            {
+                new_slab();
+            }
+            const auto batch = batches_.back();
+            batches_.pop_back();
+            return batch;
+        }
+
+        auto push( Batch batch ) -> void
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            batches_.push_back( batch );
+        }
+
+        auto slab_count() -> size_t
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            return slabs_.size();
+        }
+
+    private:
+        // Carves a new slab into batches, called with the lock held
+        auto new_slab() -> void
+        {
+            auto* slab = static_cast<std::byte*>( ::operator new( slab_size, std::align_val_t{ Align } ) );
+            slabs_.push_back( slab );
+            for ( auto first = size_t{ 0 }; first < slots_per_slab; first += batch_size )
+            {
+                const auto count = std::min( batch_size, slots_per_slab - first );
+                auto* head = static_cast<detail::FreeSlot*>( nullptr );
+                for ( auto i = first + count; i-- > first; )
+                {
+                    head = ::new ( slab + i * slot_size ) detail::FreeSlot{ head };
+                }
+                batches_.push_back( Batch{ head, count } );
+            }
+        }
+
+        std::mutex mutex_;
+        std::vector<Batch> batches_;
+        std::vector<std::byte*> slabs_;
+    };
+
+    struct ThreadCache
+    {
+        detail::FreeSlot* head_{};
+        size_t count_{};
+
+        ~ThreadCache()
+        {
+            // Give everything back in batches, the depot outlives the threads
+            while ( head_ != nullptr )
+            {
+                auto batch = Batch{ head_, 1 };
+                auto* last = head_;
+                while ( batch.count_ < batch_size && last->next_ != nullptr )
+                {
+                    last = last->next_;
+                    ++batch.count_;
+                }
+                head_ = std::exchange( last->next_, nullptr );
+                depot().push( batch );
+            }
+        }
+    };
+
+    static auto depot() -> Depot&
+    {
+        static auto d = Depot{};
+        return d;
+    }
+
+    static auto thread_cache() -> ThreadCache&
+    {
+        // Thread locals of the main thread are destroyed before the depot (a static)
+        static thread_local auto cache = ThreadCache{};
+        return cache;
+    }
+};
+
+template <class T>
+using ObjectPool = SlabPool<detail::slab_size_class( sizeof( T ) ), std::max( alignof( T ), alignof( detail::FreeSlot ) )>;
+
+// Mixin providing class-level operator new/delete from the slab pool of T's size class.
+// Arrays and derived classes of a different size go to the global operator new.
+template <class T>
+class PoolAllocated
+{
+public:
+    static auto operator new( size_t size ) -> void*
+    {
+        if ( size != sizeof( T ) )
+        {
+            return ::operator new( size );
+        }
+        return ObjectPool<T>::allocate();
+    }
+
+    static auto operator delete( void* p, size_t size ) noexcept -> void
+    {
+        if ( size != sizeof( T ) )
+        {
+            ::operator delete( p );
+            return;
+        }
+        ObjectPool<T>::deallocate( p );
+    }
+};
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A container of objects referred to by generational handles.
+//
+// Indices into a std::vector are invalidated by erase, pointers to heap objects (new CUser) dangle after delete,
+// and shared_ptr pays for a control block and atomic reference counts to avoid that.
+// A SlotMap hands out a small handle (an index and a generation) on insert instead:
+// - insert, erase and lookup by handle are O(1),
+// - a handle to an erased element is detected: find() returns nullptr, even when the slot was reused since,
+// - the elements stay packed in a single vector, so iterating over them is as fast as iterating over a std::vector.
+//
+// Erase moves the last element into the hole, so element order is not preserved,
+// and pointers and iterators are invalidated by insert and erase like a vector's (handles are not).
+//
+//     auto users = SlotMap<SUser>{};
+//     auto h = users.insert( SUser{ "John" } );
+//     users.erase( h );
+//     assert( users.find( h ) == nullptr );
+
+// A handle packed in a single word: the low index_bits are the slot index, the rest its generation.
+// 32 bit handles address about a million slots with 4096 generations each (a handle could be mistaken
+// for a newer one after its slot was reused 4096 times), 64 bit handles 4G slots with 4G generations.
+template <class Word>
+class SlotHandle
+{
+    static_assert( std::is_same_v<Word, std::uint32_t> || std::is_same_v<Word, std::uint64_t> );
+public:
+    static constexpr unsigned index_bits = sizeof( Word ) == 4 ? 20 : 32;
+    static constexpr unsigned generation_bits = sizeof( Word ) * 8 - index_bits;
+    static constexpr Word max_index = ( Word{ 1 } << index_bits ) - 1;
+    static constexpr Word max_generation = ( Word{ 1 } << generation_bits ) - 1;
+
+    SlotHandle() noexcept = default; // The null handle, never valid
+    SlotHandle( Word index, Word generation ) noexcept : value_{ ( generation << index_bits ) | index }
+    {
+        assert( index <= max_index && generation <= max_generation );
+    }
+
+    auto index() const noexcept -> Word
+    {
+        return value_ & max_index;
+    }
+    auto generation() const noexcept -> Word
+    {
+        return value_ >> index_bits;
+    }
+    // The packed word, e.g. to store the handle in another system
+    auto value() const noexcept -> Word
+    {
+        return value_;
+    }
+    static auto from_value( Word value ) noexcept -> SlotHandle
+    {
+        auto h = SlotHandle{};
+        h.value_ = value;
+        return h;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return value_ != 0;
+    }
+    auto operator==( const SlotHandle& ) const noexcept -> bool = default;
+
+private:
+    Word value_{ 0 };
+};
+
+template <class T, class Word = std::uint32_t>
+class SlotMap
+{
+public:
+    using value_type = T;
+    using handle_type = SlotHandle<Word>;
+    using iterator = typename std::vector<T>::iterator;
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    auto reserve( size_t n ) -> void
+    {
+        values_.reserve( n );
+        value_slots_.reserve( n );
+        slots_.reserve( n );
+    }
+
+    template <class... Args>
+    auto emplace( Args&&... args ) -> handle_type
+    {
+        const auto slot = acquire_slot();
+        values_.emplace_back( std::forward<Args>( args )... );
+        value_slots_.push_back( slot ); // Reserved by acquire_slot(), can't throw
+        auto& s = slots_[slot];
+        free_head_ = std::exchange( s.index_, static_cast<Word>( values_.size() - 1 ) );
+        return handle_type{ slot, s.generation_ };
+    }
+    auto insert( const T& value ) -> handle_type
+    {
+        return emplace( value );
+    }
+    auto insert( T&& value ) -> handle_type
+    {
+        return emplace( std::move( value ) );
+    }
+
+    // Returns false if h was already erased (or never valid)
+    auto erase( handle_type h ) -> bool
+    {
+        if ( !contains( h ) )
+        {
+            return false;
+        }
+        erase_value( slots_[h.index()].index_ );
+        return true;
+    }
+    // The element at it, returns the iterator to the next one (the one moved into its place)
+    auto erase( const_iterator it ) -> iterator
+    {
+        const auto i = static_cast<size_t>( it - values_.cbegin() );
+        erase_value( static_cast<Word>( i ) );
+        return values_.begin() + static_cast<std::ptrdiff_t>( i );
+    }
+
+    auto clear() -> void
+    {
+        while ( !values_.empty() )
+        {
+            erase_value( static_cast<Word>( values_.size() - 1 ) );
+        }
+    }
+
+    // Slot generations start at 1, the null handle never matches
+    auto contains( handle_type h ) const noexcept -> bool
+    {
+        return h.index() < slots_.size() && slots_[h.index()].generation_ == h.generation();
+    }
+    auto find( handle_type h ) noexcept -> T*
+    {
+        return contains( h ) ? &values_[slots_[h.index()].index_] : nullptr;
+    }
+    auto find( handle_type h ) const noexcept -> const T*
+    {
+        return contains( h ) ? &values_[slots_[h.index()].index_] : nullptr;
+    }
+    auto operator[]( handle_type h ) noexcept -> T&
+    {
+        assert( contains( h ) );
+        return values_[slots_[h.index()].index_];
+    }
+    auto operator[]( handle_type h ) const noexcept -> const T&
+    {
+        assert( contains( h ) );
+        return values_[slots_[h.index()].index_];
+    }
+    auto at( handle_type h ) -> T&
+    {
+        if ( !contains( h ) )
+        {
+            throw std::out_of_range{ "SlotMap::at: stale handle" };
+        }
+        return values_[slots_[h.index()].index_];
+    }
+    auto at( handle_type h ) const -> const T&
+    {
+        return const_cast<SlotMap*>( this )->at( h );
+    }
+
+    // The handle of an element found by iteration
+    auto handle_of( const_iterator it ) const noexcept -> handle_type
+    {
+        const auto slot = value_slots_[static_cast<size_t>( it - values_.cbegin() )];
+        return handle_type{ slot, slots_[slot].generation_ };
+    }
+
+    auto size() const noexcept -> size_t
+    {
+        return values_.size();
+    }
+    auto empty() const noexcept -> bool
+    {
+        return values_.empty();
+    }
+    auto capacity() const noexcept -> size_t
+    {
+        return values_.capacity();
+    }
+
+    // The live elements, packed, in no particular order
+    auto begin() noexcept -> iterator
+    {
+        return values_.begin();
+    }
+    auto begin() const noexcept -> const_iterator
+    {
+        return values_.begin();
+    }
+    auto end() noexcept -> iterator
+    {
+        return values_.end();
+    }
+    auto end() const noexcept -> const_iterator
+    {
+        return values_.end();
+    }
+    auto data() noexcept -> T*
+    {
+        return values_.data();
+    }
+    auto data() const noexcept -> const T*
+    {
+        return values_.data();
+    }
+
+private:
+    static constexpr Word no_slot = handle_type::max_index; // Never used as a slot, ends the free list
+
+    // Indirection from a handle's index to the element
+    struct Slot
+    {
+        Word index_;      // The element's position in values_ while the slot is used, the next free slot otherwise
+        Word generation_; // Bumped on erase, so the handles to the erased element no longer match
+    };
+
+    auto acquire_slot() -> Word
+    {
+        // Everything that can throw happens before the element is added
+        grow( values_ );
+        grow( value_slots_ );
+        if ( free_head_ != no_slot )
+        {
+            return free_head_;
+        }
+        if ( slots_.size() == no_slot )
+        {
+            throw std::length_error{ "SlotMap: out of handle indices" };
+        }
+        slots_.push_back( Slot{ no_slot, 1 } );
+        free_head_ = static_cast<Word>( slots_.size() - 1 );
+        return free_head_;
+    }
+
+    // Geometric growth done ahead of push_back (reserve( size() + 1 ) would allocate exactly that)
+    template <class V>
+    static auto grow( V& v ) -> void
+    {
+        if ( v.size() == v.capacity() )
+        {
+            v.reserve( std::max<size_t>( 2 * v.capacity(), 1 ) );
+        }
+    }
+
+    auto erase_value( Word i ) -> void
+    {
+        const auto slot = value_slots_[i];
+        const auto last = static_cast<Word>( values_.size() - 1 );
+        if ( i != last )
+        {
+            values_[i] = std::move( values_[last] );
+            value_slots_[i] = value_slots_[last];
+            slots_[value_slots_[i]].index_ = i;
+        }
+        values_.pop_back();
+        value_slots_.pop_back();
+
+        auto& s = slots_[slot];
+        s.generation_ = s.generation_ == handle_type::max_generation ? 1 : s.generation_ + 1; // 0 only in the null handle
+        s.index_ = std::exchange( free_head_, slot );
+    }
+
+    std::vector<T> values_;
+    std::vector<Word> value_slots_; // The slot of each element, to fix it up when the element moves
+    std::vector<Slot> slots_;
+    Word free_head_{ no_slot };
+};
@@ -0,0 +1,530 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// A vector with inline storage for N elements, only going to the heap when it grows past them.
+//
+// std::vector{ 2, 3 } allocates. A ShortAlloc-based vector doesn't, but needs an arena declared next to it
+// and is bigger than a std::vector. SmallVector<int, 4>{ 2, 3 } keeps its elements in the object itself,
+// like a stack array, and keeps working like a std::vector when the collection turns out bigger than expected.
+//
+// The API follows std::vector (iterators are pointers). Unlike std::vector, moving a SmallVector that is
+// still inline moves its elements one by one, and it invalidates iterators and references.
+//
+// Growing relocates the elements to a new buffer. Types for which IsTriviallyRelocatable is true are moved with
+// a memcpy instead of a move construction and destruction per element.
+
+// True when moving an object to another address and forgetting the old one is a plain memcpy.
+// Trivially copyable types are; specialize it for others that are too, e.g. a class that only owns a heap pointer.
+// (libstdc++'s std::string is not: it points into itself while its characters fit in the small string buffer.)
+template <class T>
+struct IsTriviallyRelocatable : std::bool_constant<std::is_trivially_copyable_v<T>>
+{};
+
+template <class T, size_t N>
+class SmallVector
+{
+    static_assert( N > 0, "Use std::vector for no inline storage" );
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = T&;
+    using const_reference = const T&;
+    using pointer = T*;
+    using const_pointer = const T*;
+    using iterator = T*;
+    using const_iterator = const T*;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    static constexpr size_t inline_capacity = N;
+
+    SmallVector() noexcept = default;
+    explicit SmallVector( size_t n )
+    {
+        resize( n );
+    }
+    SmallVector( size_t n, const T& value )
+    {
+        resize( n, value );
+    }
+    template <std::input_iterator It>
+    SmallVector( It first, It last )
+    {
+        append( first, last );
+    }
+    SmallVector( std::initializer_list<T> il )
+    {
+        append( il.begin(), il.end() );
+    }
+    SmallVector( const SmallVector& other )
+    {
+        append( other.begin(), other.end() );
+    }
+    SmallVector( SmallVector&& other ) noexcept( std::is_nothrow_move_constructible_v<T> )
+    {
+        take( std::move( other ) );
+    }
+    ~SmallVector()
+    {
+        clear();
+        release_heap();
+    }
+
+    auto operator=( const SmallVector& other ) -> SmallVector&
+    {
+        if ( this != &other )
+        {
+            assign( other.begin(), other.end() );
+        }
+        return *this;
+    }
+    auto operator=( SmallVector&& other ) noexcept( std::is_nothrow_move_constructible_v<T> ) -> SmallVector&
+    {
+        if ( this != &other )
+        {
+            clear();
+            if ( !other.is_inline() )
+            {
+                release_heap();
+            }
+            take( std::move( other ) );
+        }
+        return *this;
+    }
+    auto operator=( std::initializer_list<T> il ) -> SmallVector&
+    {
+        assign( il.begin(), il.end() );
+        return *this;
+    }
+
+    template <std::input_iterator It>
+    auto assign( It first, It last ) -> void
+    {
+        clear();
+        append( first, last );
+    }
+    auto assign( size_t n, const T& value ) -> void
+    {
+        const auto copy = value; // Might be one of ours
+        clear();
+        resize( n, copy );
+    }
+    auto assign( std::initializer_list<T> il ) -> void
+    {
+        assign( il.begin(), il.end() );
+    }
+
+    //-------------------------------------------------------------------------
+
+    auto operator[]( size_t i ) noexcept -> T&
+    {
+        return data_[i];
+    }
+    auto operator[]( size_t i ) const noexcept -> const T&
+    {
+        return data_[i];
+    }
+    auto at( size_t i ) -> T&
+    {
+        if ( i >= size_ )
+        {
+            throw std::out_of_range{ "SmallVector::at" };
+        }
+        return data_[i];
+    }
+    auto at( size_t i ) const -> const T&
+    {
+        return const_cast<SmallVector*>( this )->at( i );
+    }
+    auto front() noexcept -> T&
+    {
+        return data_[0];
+    }
+    auto front() const noexcept -> const T&
+    {
+        return data_[0];
+    }
+    auto back() noexcept -> T&
+    {
+        return data_[size_ - 1];
+    }
+    auto back() const noexcept -> const T&
+    {
+        return data_[size_ - 1];
+    }
+    auto data() noexcept -> T*
+    {
+        return data_;
+    }
+    auto data() const noexcept -> const T*
+    {
+        return data_;
+    }
+
+    auto begin() noexcept -> iterator
+    {
+        return data_;
+    }
+    auto begin() const noexcept -> const_iterator
+    {
+        return data_;
+    }
+    auto end() noexcept -> iterator
+    {
+        return data_ + size_;
+    }
+    auto end() const noexcept -> const_iterator
+    {
+        return data_ + size_;
+    }
+    auto cbegin() const noexcept -> const_iterator
+    {
+        return begin();
+    }
+    auto cend() const noexcept -> const_iterator
+    {
+        return end();
+    }
+    auto rbegin() noexcept -> reverse_iterator
+    {
+        return reverse_iterator{ end() };
+    }
+    auto rbegin() const noexcept -> const_reverse_iterator
+    {
+        return const_reverse_iterator{ end() };
+    }
+    auto rend() noexcept -> reverse_iterator
+    {
+        return reverse_iterator{ begin() };
+    }
+    auto rend() const noexcept -> const_reverse_iterator
+    {
+        return const_reverse_iterator{ begin() };
+    }
+
+    //-------------------------------------------------------------------------
+
+    auto empty() const noexcept -> bool
+    {
+        return size_ == 0;
+    }
+    auto size() const noexcept -> size_t
+    {
+        return size_;
+    }
+    static constexpr auto max_size() noexcept -> size_t
+    {
+        return std::numeric_limits<size_t>::max() / sizeof( T );
+    }
+    auto capacity() const noexcept -> size_t
+    {
+        return capacity_;
+    }
+    // Whether the elements are still in the inline storage
+    auto is_inline() const noexcept -> bool
+    {
+        return data_ == inline_data();
+    }
+
+    auto reserve( size_t n ) -> void
+    {
+        if ( n > capacity_ )
+        {
+            reallocate( n );
+        }
+    }
+    // Back to the inline storage if the elements fit
+    auto shrink_to_fit() -> void
+    {
+        if ( !is_inline() && size_ < capacity_ )
+        {
+            reallocate( size_ );
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    auto clear() noexcept -> void
+    {
+        std::destroy_n( data_, size_ );
+        size_ = 0;
+    }
+
+    template <class... Args>
+    auto emplace_back( Args&&... args ) -> T&
+    {
+        if ( size_ == capacity_ ) [[unlikely]]
+        {
+            return grow_and_emplace_back( std::forward<Args>( args )... );
+        }
+        auto* p = std::construct_at( data_ + size_, std::forward<Args>( args )... );
+        ++size_;
+        return *p;
+    }
+    auto push_back( const T& value ) -> void
+    {
+        emplace_back( value );
+    }
+    auto push_back( T&& value ) -> void
+    {
+        emplace_back( std::move( value ) );
+    }
+    auto pop_back() noexcept -> void
+    {
+        std::destroy_at( data_ + --size_ );
+    }
+
+    auto resize( size_t n ) -> void
+    {
+        if ( n <= size_ )
+        {
+            std::destroy( data_ + n, data_ + size_ );
+        }
+        else
+        {
+            reserve( n );
+            std::uninitialized_value_construct( data_ + size_, data_ + n );
+        }
+        size_ = n;
+    }
+    auto resize( size_t n, const T& value ) -> void
+    {
+        if ( n <= size_ )
+        {
+            std::destroy( data_ + n, data_ + size_ );
+        }
+        else if ( n <= capacity_ )
+        {
+            std::uninitialized_fill( data_ + size_, data_ + n, value );
+        }
+        else
+        {
+            const auto copy = value; // Might be one of ours
+            reserve( n );
+            std::uninitialized_fill( data_ + size_, data_ + n, copy );
+        }
+        size_ = n;
+    }
+
+    // Inserting appends at the end and rotates the new elements into place,
+    // so a value referring to one of our own elements is copied before anything moves
+    template <class... Args>
+    auto emplace( const_iterator pos, Args&&... args ) -> iterator
+    {
+        const auto i = pos - begin();
+        emplace_back( std::forward<Args>( args )... );
+        std::rotate( begin() + i, end() - 1, end() );
+        return begin() + i;
+    }
+    auto insert( const_iterator pos, const T& value ) -> iterator
+    {
+        return emplace( pos, value );
+    }
+    auto insert( const_iterator pos, T&& value ) -> iterator
+    {
+        return emplace( pos, std::move( value ) );
+    }
+    auto insert( const_iterator pos, size_t n, const T& value ) -> iterator
+    {
+        const auto i = pos - begin();
+        const auto old_size = size_;
+        resize( size_ + n, value );
+        std::rotate( begin() + i, begin() + old_size, end() );
+        return begin() + i;
+    }
+    template <std::input_iterator It>
+    auto insert( const_iterator pos, It first, It last ) -> iterator
+    {
+        const auto i = pos - begin();
+        const auto old_size = size_;
+        append( first, last );
+        std::rotate( begin() + i, begin() + old_size, end() );
+        return begin() + i;
+    }
+    auto insert( const_iterator pos, std::initializer_list<T> il ) -> iterator
+    {
+        return insert( pos, il.begin(), il.end() );
+    }
+
+    auto erase( const_iterator pos ) -> iterator
+    {
+        return erase( pos, pos + 1 );
+    }
+    auto erase( const_iterator first, const_iterator last ) -> iterator
+    {
+        auto* f = begin() + ( first - begin() );
+        auto* l = begin() + ( last - begin() );
+        if ( f != l )
+        {
+            auto* new_end = std::move( l, end(), f );
+            std::destroy( new_end, end() );
+            size_ -= static_cast<size_t>( l - f );
+        }
+        return f;
+    }
+
+    auto swap( SmallVector& other ) noexcept( std::is_nothrow_move_constructible_v<T> ) -> void
+    {
+        auto tmp = std::move( other );
+        other = std::move( *this );
+        *this = std::move( tmp );
+    }
+    friend auto swap( SmallVector& a, SmallVector& b ) noexcept( std::is_nothrow_move_constructible_v<T> ) -> void
+    {
+        a.swap( b );
+    }
+
+    friend auto operator==( const SmallVector& a, const SmallVector& b ) -> bool
+    {
+        return std::equal( a.begin(), a.end(), b.begin(), b.end() );
+    }
+    friend auto operator<=>( const SmallVector& a, const SmallVector& b )
+    {
+        return std::lexicographical_compare_three_way( a.begin(), a.end(), b.begin(), b.end() );
+    }
+
+private:
+    auto inline_data() noexcept -> T*
+    {
+        return reinterpret_cast<T*>( inline_ );
+    }
+    auto inline_data() const noexcept -> const T*
+    {
+        return reinterpret_cast<const T*>( inline_ );
+    }
+
+    // Moves n elements to uninitialized dst and ends the lifetime of the originals
+    static auto relocate( T* src, size_t n, T* dst ) noexcept( IsTriviallyRelocatable<T>::value || std::is_nothrow_move_constructible_v<T> ) -> void
+    {
+        if constexpr ( IsTriviallyRelocatable<T>::value )
+        {
+            if ( n != 0 )
+            {
+                std::memcpy( static_cast<void*>( dst ), static_cast<const void*>( src ), n * sizeof( T ) );
+            }
+        }
+        else
+        {
+            std::uninitialized_move_n( src, n, dst );
+            std::destroy_n( src, n );
+        }
+    }
+
+    auto release_heap() noexcept -> void
+    {
+        if ( !is_inline() )
+        {
+            std::allocator<T>{}.deallocate( data_, capacity_ );
+            data_ = inline_data();
+            capacity_ = N;
+        }
+    }
+
+    // Moves the elements to a buffer of the given capacity, the inline storage if it fits
+    auto reallocate( size_t new_capacity ) -> void
+    {
+        if ( new_capacity > max_size() )
+        {
+            throw std::length_error{ "SmallVector too long" };
+        }
+        auto* new_data = new_capacity <= N ? inline_data() : std::allocator<T>{}.allocate( new_capacity );
+        if ( new_data == data_ )
+        {
+            return;
+        }
+        try
+        {
+            relocate( data_, size_, new_data );
+        }
+        catch ( ... )
+        {
+            if ( new_data != inline_data() )
+            {
+                std::allocator<T>{}.deallocate( new_data, new_capacity );
+            }
+            throw;
+        }
+        release_heap();
+        data_ = new_data;
+        capacity_ = std::max( new_capacity, N );
+    }
+
+    auto next_capacity( size_t min_capacity ) const noexcept -> size_t
+    {
+        return std::max( min_capacity, capacity_ * 2 );
+    }
+
+    template <class... Args>
+    auto grow_and_emplace_back( Args&&... args ) -> T&
+    {
+        // The new element is constructed first, as args may refer to an element about to be relocated
+        const auto new_capacity = next_capacity( size_ + 1 );
+        auto* new_data = std::allocator<T>{}.allocate( new_capacity );
+        T* p{};
+        try
+        {
+            p = std::construct_at( new_data + size_, std::forward<Args>( args )... );
+            relocate( data_, size_, new_data );
+        }
+        catch ( ... )
+        {
+            if ( p != nullptr )
+            {
+                std::destroy_at( p );
+            }
+            std::allocator<T>{}.deallocate( new_data, new_capacity );
+            throw;
+        }
+        release_heap();
+        data_ = new_data;
+        capacity_ = new_capacity;
+        ++size_;
+        return *p;
+    }
+
+    template <class It>
+    auto append( It first, It last ) -> void
+    {
+        if constexpr ( std::forward_iterator<It> )
+        {
+            reserve( size_ + static_cast<size_t>( std::distance( first, last ) ) );
+        }
+        for ( ; first != last; ++first )
+        {
+            emplace_back( *first );
+        }
+    }
+
+    // Takes the elements of other, which is left empty. Called with *this empty.
+    auto take( SmallVector&& other ) noexcept( std::is_nothrow_move_constructible_v<T> ) -> void
+    {
+        if ( !other.is_inline() )
+        {
+            data_ = std::exchange( other.data_, other.inline_data() );
+            capacity_ = std::exchange( other.capacity_, N );
+            size_ = std::exchange( other.size_, 0 );
+            return;
+        }
+        std::uninitialized_move_n( other.data_, other.size_, data_ );
+        size_ = other.size_;
+        other.clear();
+    }
+
+    T* data_{ inline_data() };
+    size_t size_{ 0 };
+    size_t capacity_{ N };
+    alignas( T ) std::byte inline_[N * sizeof( T )];
+};
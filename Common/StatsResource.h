@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A memory resource decorator that counts what goes through it.
+//
+// Printing every allocation (like PrintingResource did) takes a lock and does I/O on every call,
+// so it can't be left on. StatsResource only bumps relaxed atomics and forwards to its upstream resource,
+// so it can stay in front of a subsystem's allocations all the time and be queried when needed:
+// - allocations, deallocations and bytes allocated,
+// - live bytes and their peak,
+// - a histogram of the requested sizes (powers of two) and one of the requested alignments.
+//
+// Resources are named after the subsystem they serve and chain like any other memory resource:
+//
+//     auto parser_memory = StatsResource{ "parser", &pool };
+//     auto tokens = std::pmr::vector<Token>{ &parser_memory };
+//     ...
+//     StatsResource::print_all( std::cout ); // The profile of every live StatsResource
+
+class StatsResource : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t size_bucket_count = 24; // <= 16 B, <= 32 B, ..., <= 64 MiB, larger
+    static constexpr size_t align_bucket_count = 13; // 1, 2, 4, ..., 4096 and larger
+
+    struct Snapshot
+    {
+        std::string name_;
+        std::uint64_t allocations_{};
+        std::uint64_t deallocations_{};
+        std::uint64_t bytes_allocated_{};
+        std::uint64_t live_bytes_{};
+        std::uint64_t peak_live_bytes_{};
+        std::array<std::uint64_t, size_bucket_count> sizes_{};
+        std::array<std::uint64_t, align_bucket_count> alignments_{};
+
+        auto print( std::ostream& os ) const -> void
+        {
+            char buf[160];
+            std::snprintf( buf, sizeof( buf ), "%llu allocations, %llu deallocations, %llu bytes allocated, %llu live, %llu peak",
+                           static_cast<unsigned long long>( allocations_ ), static_cast<unsigned long long>( deallocations_ ),
+                           static_cast<unsigned long long>( bytes_allocated_ ), static_cast<unsigned long long>( live_bytes_ ),
+                           static_cast<unsigned long long>( peak_live_bytes_ ) );
+            os << name_ << ": " << buf << '\n';
+            if ( allocations_ == 0 )
+            {
+                return;
+            }
+            os << "  sizes: ";
+            for ( auto i = size_t{ 0 }; i < size_bucket_count; ++i )
+            {
+                if ( sizes_[i] != 0 )
+                {
+                    os << ( i + 1 == size_bucket_count ? ">" : "<=" ) << format_bytes( size_t{ 16 } << std::min( i, size_bucket_count - 2 ) )
+                       << " x" << sizes_[i] << "  ";
+                }
+            }
+            os << "\n  alignments: ";
+            for ( auto i = size_t{ 0 }; i < align_bucket_count; ++i )
+            {
+                if ( alignments_[i] != 0 )
+                {
+                    os << ( i + 1 == align_bucket_count ? ">=" : "" ) << ( size_t{ 1 } << i ) << " x" << alignments_[i] << "  ";
+                }
+            }
+            os << '\n';
+        }
+    };
+
+    explicit StatsResource( std::string name, std::pmr::memory_resource* upstream = std::pmr::get_default_resource() )
+        : name_{ std::move( name ) }, upstream_{ upstream }
+    {
+        registry().add( this );
+    }
+    StatsResource( const StatsResource& ) = delete;
+    StatsResource& operator=( const StatsResource& ) = delete;
+    ~StatsResource()
+    {
+        registry().remove( this );
+    }
+
+    auto name() const noexcept -> const std::string&
+    {
+        return name_;
+    }
+    auto upstream() const noexcept -> std::pmr::memory_resource*
+    {
+        return upstream_;
+    }
+    auto live_bytes() const noexcept -> std::uint64_t
+    {
+        return live_bytes_.load( std::memory_order_relaxed );
+    }
+    auto peak_live_bytes() const noexcept -> std::uint64_t
+    {
+        return peak_live_bytes_.load( std::memory_order_relaxed );
+    }
+
+    // The counters are read one by one while other threads may still allocate,
+    // so a snapshot is only exact when the resource is idle
+    auto snapshot() const -> Snapshot
+    {
+        auto s = Snapshot{ name_ };
+        s.allocations_ = allocations_.load( std::memory_order_relaxed );
+        s.deallocations_ = deallocations_.load( std::memory_order_relaxed );
+        s.bytes_allocated_ = bytes_allocated_.load( std::memory_order_relaxed );
+        s.live_bytes_ = live_bytes();
+        s.peak_live_bytes_ = peak_live_bytes();
+        for ( auto i = size_t{ 0 }; i < size_bucket_count; ++i )
+        {
+            s.sizes_[i] = sizes_[i].load( std::memory_order_relaxed );
+        }
+        for ( auto i = size_t{ 0 }; i < align_bucket_count; ++i )
+        {
+            s.alignments_[i] = alignments_[i].load( std::memory_order_relaxed );
+        }
+        return s;
+    }
+
+    auto print( std::ostream& os ) const -> void
+    {
+        snapshot().print( os );
+    }
+
+    // Every StatsResource alive right now, in creation order
+    static auto snapshots() -> std::vector<Snapshot>
+    {
+        return registry().snapshots();
+    }
+    static auto print_all( std::ostream& os ) -> void
+    {
+        os << "\n-- memory resources --\n";
+        for ( const auto& s : snapshots() )
+        {
+            s.print( os );
+        }
+    }
+
+private:
+    class Registry
+    {
+    public:
+        auto add( StatsResource* r ) -> void
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            resources_.push_back( r );
+        }
+        auto remove( StatsResource* r ) -> void
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            resources_.erase( std::find( resources_.begin(), resources_.end(), r ) );
+        }
+        auto snapshots() -> std::vector<Snapshot>
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            auto result = std::vector<Snapshot>{};
+            for ( const auto* r : resources_ )
+            {
+                result.push_back( r->snapshot() );
+            }
+            return result;
+        }
+    private:
+        std::mutex mutex_;
+        std::vector<StatsResource*> resources_;
+    };
+
+    static auto registry() -> Registry&
+    {
+        static auto r = Registry{};
+        return r;
+    }
+
+    static auto format_bytes( size_t bytes ) -> std::string
+    {
+        if ( bytes >= ( size_t{ 1 } << 20 ) )
+            return std::to_string( bytes >> 20 ) + " MiB";
+        if ( bytes >= ( size_t{ 1 } << 10 ) )
+            return std::to_string( bytes >> 10 ) + " KiB";
+        return std::to_string( bytes ) + " B";
+    }
+
+    static auto size_bucket( size_t bytes ) noexcept -> size_t
+    {
+        const auto log2 = static_cast<size_t>( std::bit_width( std::max<size_t>( bytes, 16 ) - 1 ) ); // ceil( log2( bytes ) )
+        return std::min( log2 - 4, size_bucket_count - 1 );
+    }
+
+    static auto align_bucket( size_t align ) noexcept -> size_t
+    {
+        return std::min( static_cast<size_t>( std::countr_zero( align ) ), align_bucket_count - 1 );
+    }
+
+    auto do_allocate( size_t bytes, size_t align ) -> void* override
+    {
+        auto* p = upstream_->allocate( bytes, align ); // Failed allocations are not counted
+        allocations_.fetch_add( 1, std::memory_order_relaxed );
+        bytes_allocated_.fetch_add( bytes, std::memory_order_relaxed );
+        sizes_[size_bucket( bytes )].fetch_add( 1, std::memory_order_relaxed );
+        alignments_[align_bucket( align )].fetch_add( 1, std::memory_order_relaxed );
+        const auto live = live_bytes_.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+        auto peak = peak_live_bytes_.load( std::memory_order_relaxed );
+        while ( live > peak && !peak_live_bytes_.compare_exchange_weak( peak, live, std::memory_order_relaxed ) )
+        {}
+        return p;
+    }
+
+    auto do_deallocate( void* p, size_t bytes, size_t align ) -> void override
+    {
+        upstream_->deallocate( p, bytes, align );
+        deallocations_.fetch_add( 1, std::memory_order_relaxed );
+        live_bytes_.fetch_sub( bytes, std::memory_order_relaxed );
+    }
+
+    auto do_is_equal( const std::pmr::memory_resource& other ) const noexcept -> bool override
+    {
+        return this == &other;
+    }
+
+    std::string name_;
+    std::pmr::memory_resource* upstream_;
+    std::atomic<std::uint64_t> allocations_{ 0 };
+    std::atomic<std::uint64_t> deallocations_{ 0 };
+    std::atomic<std::uint64_t> bytes_allocated_{ 0 };
+    std::atomic<std::uint64_t> live_bytes_{ 0 };
+    std::atomic<std::uint64_t> peak_live_bytes_{ 0 };
+    std::array<std::atomic<std::uint64_t>, size_bucket_count> sizes_{};
+    std::array<std::atomic<std::uint64_t>, align_bucket_count> alignments_{};
+};
@@ -0,0 +1,775 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef NOMINMAX
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <sys/mman.h>
+#endif
+
+// A general purpose thread-caching allocator, in the spirit of tcmalloc.
+//
+// glibc malloc gives threads their own arenas but still takes an arena lock on every call,
+// and memory freed by another thread goes back to the arena it came from. Many threads churning
+// small objects (futures, task states, small vectors) end up fighting over those locks.
+//
+// Three layers, each one only visited when the one above runs dry:
+// - Thread cache: one freelist per size class and thread, no lock at all.
+// - Central transfer cache: per size class, moves objects in batches between thread caches,
+//   so its lock is taken once per batch instead of once per allocation.
+// - Page heap: hands out spans (runs of 8 KiB pages) from a reserved address range, splits them
+//   and coalesces them again when they are freed. A page map tells which span a page belongs to,
+//   which is how deallocate() finds the size class of a pointer without any header.
+//
+// Sizes up to 256 KiB are rounded to one of 52 size classes (16 byte steps up to 128 B, then four
+// classes per power of two, so at most 25% is wasted), larger requests get their own span.
+// Alignments up to a page come for free from the size classes, larger ones from over-sized spans.
+// Small object spans are kept by their size class for the lifetime of the program.
+//
+// To replace the global operator new/delete, in exactly one translation unit of the program:
+//
+//   #define THREAD_CACHING_ALLOCATOR_REPLACE_NEW
+//   #include "ThreadCachingAllocator.h"
+
+class ThreadCachingAllocator
+{
+public:
+    static constexpr size_t page_shift = 13;
+    static constexpr size_t page_size = size_t{ 1 } << page_shift;
+    static constexpr size_t max_small_size = size_t{ 256 } << 10;
+    // Address space reserved up front, only committed as the heap grows
+    static constexpr size_t region_size = sizeof( void* ) == 8 ? size_t{ 64 } << 30 : size_t{ 1 } << 30;
+
+    struct Stats
+    {
+        size_t committed_bytes_{}; // Taken from the OS
+        size_t small_span_bytes_{}; // Carved into size classes
+        size_t large_bytes_{}; // In use by large allocations
+    };
+
+    // Returns nullptr when out of memory
+    static auto allocate( size_t size, size_t align = alignof( std::max_align_t ) ) noexcept -> void*
+    {
+        size = std::max<size_t>( size, 1 );
+        if ( align <= alignof( std::max_align_t ) && size <= max_small_size ) [[likely]]
+        {
+            return allocate_small( size_class( size ) );
+        }
+        if ( align <= page_size && size <= max_small_size )
+        {
+            // Objects of a class sit at multiples of its size from the start of a page aligned span,
+            // the power of two classes guarantee there is always a class that works
+            auto cls = size_class( ( size + align - 1 ) & ~( align - 1 ) );
+            while ( class_size( cls ) % align != 0 )
+            {
+                ++cls;
+            }
+            return allocate_small( cls );
+        }
+        return allocate_large( size, align );
+    }
+
+    static auto deallocate( void* p ) noexcept -> void
+    {
+        if ( p == nullptr )
+        {
+            return;
+        }
+        const auto cls = span_of( p )->size_class_;
+        if ( cls == 0 )
+        {
+            deallocate_large( p );
+            return;
+        }
+        if ( cache_state_ != thread_active ) [[unlikely]]
+        {
+            if ( cache_state_ == thread_exited )
+            {
+                next( p ) = nullptr;
+                central_release( cls, p, 1 );
+                return;
+            }
+            // A thread that only frees (e.g. the one running a std::async task) must flush its cache too
+            static thread_local auto flusher = ThreadCacheFlusher{};
+            cache_state_ = thread_active;
+        }
+        auto& list = cache_[cls];
+        next( p ) = list.head_;
+        list.head_ = p;
+        if ( ++list.count_ >= 2 * batch_size( cls ) ) [[unlikely]]
+        {
+            release_batch( cls, list );
+        }
+    }
+
+    // Bytes that can be used at p, at least the requested size
+    static auto usable_size( const void* p ) noexcept -> size_t
+    {
+        const auto* span = span_of( p );
+        if ( span->size_class_ != 0 )
+        {
+            return class_size( span->size_class_ );
+        }
+        return span->page_count_ * page_size - static_cast<size_t>( static_cast<const std::byte*>( p ) - page_address( span->first_page_ ) );
+    }
+
+    static auto stats() noexcept -> Stats
+    {
+        auto lck = std::scoped_lock{ heap_.mutex_ };
+        return Stats{ heap_.committed_pages_ * page_size, heap_.small_pages_ * page_size, heap_.large_pages_ * page_size };
+    }
+
+    //-------------------------------------------------------------------------
+
+    static constexpr size_t class_count = 1 + 8 + 11 * 4; // 0 is for large spans
+
+    static constexpr auto size_class( size_t size ) noexcept -> size_t
+    {
+        if ( size <= 128 )
+        {
+            return ( size + 15 ) >> 4;
+        }
+        const auto p = static_cast<size_t>( std::bit_width( size - 1 ) ) - 1; // 2^p < size <= 2^(p+1)
+        const auto quarter = ( ( size - 1 ) >> ( p - 2 ) ) - 4;
+        return 9 + ( p - 7 ) * 4 + quarter;
+    }
+
+    static constexpr auto class_size( size_t cls ) noexcept -> size_t
+    {
+        if ( cls <= 8 )
+        {
+            return cls * 16;
+        }
+        const auto p = ( cls - 9 ) / 4 + 7;
+        const auto quarter = ( cls - 9 ) % 4;
+        return ( size_t{ 1 } << p ) + ( quarter + 1 ) * ( size_t{ 1 } << ( p - 2 ) );
+    }
+
+private:
+    // Objects moved between a thread cache and the central cache at once
+    static constexpr auto batch_size( size_t cls ) noexcept -> size_t
+    {
+        return std::clamp<size_t>( ( size_t{ 64 } << 10 ) / class_size( cls ), 2, 32 );
+    }
+
+    // At least 8 objects per span, at least 64 KiB
+    static constexpr auto span_pages( size_t cls ) noexcept -> size_t
+    {
+        return ( std::max( class_size( cls ) * 8, size_t{ 64 } << 10 ) + page_size - 1 ) >> page_shift;
+    }
+
+    // A free object links to the next one in its first word, the first object of a batch
+    // in the central cache links to the next batch in its second word
+    static auto next( void* p ) noexcept -> void*&
+    {
+        return static_cast<void**>( p )[0];
+    }
+    static auto next_batch( void* p ) noexcept -> void*&
+    {
+        return static_cast<void**>( p )[1];
+    }
+
+    //-------------------------------------------------------------------------
+    // OS layer
+
+    static auto os_reserve( size_t size ) noexcept -> void*
+    {
+#if defined(_WIN32)
+        return ::VirtualAlloc( nullptr, size, MEM_RESERVE, PAGE_NOACCESS );
+#else
+        auto* p = ::mmap( nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+        return p == MAP_FAILED ? nullptr : p;
+#endif
+    }
+
+    // Committing an already committed range is harmless
+    static auto os_commit( void* p, size_t size ) noexcept -> bool
+    {
+        constexpr auto os_page = std::uintptr_t{ 4096 };
+        const auto first = reinterpret_cast<std::uintptr_t>( p ) & ~( os_page - 1 );
+        const auto last = ( reinterpret_cast<std::uintptr_t>( p ) + size + os_page - 1 ) & ~( os_page - 1 );
+#if defined(_WIN32)
+        return ::VirtualAlloc( reinterpret_cast<void*>( first ), last - first, MEM_COMMIT, PAGE_READWRITE ) != nullptr;
+#else
+        return ::mprotect( reinterpret_cast<void*>( first ), last - first, PROT_READ | PROT_WRITE ) == 0;
+#endif
+    }
+
+    //-------------------------------------------------------------------------
+    // Page heap
+
+    struct Span
+    {
+        size_t first_page_{};
+        size_t page_count_{};
+        Span* prev_{};
+        Span* next_{};
+        size_t size_class_{}; // 0 for large spans
+        bool free_{};
+    };
+
+    static constexpr size_t listed_pages = 128; // Larger free spans share one list
+    static constexpr size_t grow_pages = ( size_t{ 2 } << 20 ) >> page_shift;
+    static constexpr size_t total_pages = region_size >> page_shift;
+
+    struct PageHeap
+    {
+        std::mutex mutex_;
+        std::byte* base_{};
+        Span** page_map_{};
+        size_t committed_pages_{};
+        size_t small_pages_{};
+        size_t large_pages_{};
+        Span* free_lists_[listed_pages + 1]{};
+        Span* spare_spans_{}; // Recycled span descriptors
+        std::byte* meta_ptr_{};
+        std::byte* meta_end_{};
+    };
+
+    static auto page_address( size_t page ) noexcept -> std::byte*
+    {
+        return heap_.base_ + ( page << page_shift );
+    }
+
+    static auto span_of( const void* p ) noexcept -> Span*
+    {
+        return heap_.page_map_[static_cast<size_t>( static_cast<const std::byte*>( p ) - heap_.base_ ) >> page_shift];
+    }
+
+    // Everything below runs with heap_.mutex_ held
+
+    static auto init_heap() noexcept -> bool
+    {
+        // The OS only aligns to its 4 KiB pages, spans must start on our 8 KiB ones
+        // (the size classes and allocate_large() rely on page aligned spans)
+        auto* reserved = static_cast<std::byte*>( os_reserve( region_size + page_size ) );
+        if ( reserved != nullptr )
+        {
+            const auto address = reinterpret_cast<std::uintptr_t>( reserved );
+            heap_.base_ = reserved + ( ( page_size - ( address & ( page_size - 1 ) ) ) & ( page_size - 1 ) );
+        }
+        heap_.page_map_ = static_cast<Span**>( os_reserve( total_pages * sizeof( Span* ) ) );
+        return heap_.base_ != nullptr && heap_.page_map_ != nullptr;
+    }
+
+    // Span descriptors can't come from operator new, they are bumped out of their own OS chunks
+    static auto new_span( size_t first_page, size_t page_count ) noexcept -> Span*
+    {
+        auto* span = heap_.spare_spans_;
+        if ( span != nullptr )
+        {
+            heap_.spare_spans_ = span->next_;
+        }
+        else
+        {
+            if ( heap_.meta_ptr_ == heap_.meta_end_ )
+            {
+                constexpr auto chunk = size_t{ 64 } << 10;
+                heap_.meta_ptr_ = static_cast<std::byte*>( os_reserve( chunk ) );
+                if ( heap_.meta_ptr_ == nullptr || !os_commit( heap_.meta_ptr_, chunk ) )
+                {
+                    heap_.meta_ptr_ = heap_.meta_end_ = nullptr;
+                    return nullptr;
+                }
+                heap_.meta_end_ = heap_.meta_ptr_ + chunk / sizeof( Span ) * sizeof( Span );
+            }
+            span = reinterpret_cast<Span*>( heap_.meta_ptr_ );
+            heap_.meta_ptr_ += sizeof( Span );
+        }
+        return ::new ( span ) Span{ first_page, page_count };
+    }
+
+    static auto delete_span( Span* span ) noexcept -> void
+    {
+        span->next_ = heap_.spare_spans_;
+        heap_.spare_spans_ = span;
+    }
+
+    static auto free_list( size_t page_count ) noexcept -> Span*&
+    {
+        return heap_.free_lists_[std::min( page_count, listed_pages )];
+    }
+
+    static auto unlink( Span* span ) noexcept -> void
+    {
+        ( span->prev_ != nullptr ? span->prev_->next_ : free_list( span->page_count_ ) ) = span->next_;
+        if ( span->next_ != nullptr )
+        {
+            span->next_->prev_ = span->prev_;
+        }
+    }
+
+    // Free spans only map their first and last page, that is all coalescing needs
+    static auto insert_free( Span* span ) noexcept -> void
+    {
+        span->free_ = true;
+        span->size_class_ = 0;
+        heap_.page_map_[span->first_page_] = span;
+        heap_.page_map_[span->first_page_ + span->page_count_ - 1] = span;
+        auto& head = free_list( span->page_count_ );
+        span->prev_ = nullptr;
+        span->next_ = head;
+        if ( head != nullptr )
+        {
+            head->prev_ = span;
+        }
+        head = span;
+    }
+
+    static auto free_span( Span* span ) noexcept -> void
+    {
+        if ( span->first_page_ > 0 )
+        {
+            auto* prev = heap_.page_map_[span->first_page_ - 1];
+            if ( prev != nullptr && prev->free_ )
+            {
+                unlink( prev );
+                span->first_page_ = prev->first_page_;
+                span->page_count_ += prev->page_count_;
+                delete_span( prev );
+            }
+        }
+        const auto after = span->first_page_ + span->page_count_;
+        if ( after < heap_.committed_pages_ )
+        {
+            auto* next = heap_.page_map_[after];
+            if ( next != nullptr && next->free_ )
+            {
+                unlink( next );
+                span->page_count_ += next->page_count_;
+                delete_span( next );
+            }
+        }
+        insert_free( span );
+    }
+
+    static auto grow( size_t page_count ) noexcept -> bool
+    {
+        if ( heap_.base_ == nullptr && !init_heap() )
+        {
+            return false;
+        }
+        page_count = std::max( page_count, grow_pages );
+        const auto first = heap_.committed_pages_;
+        if ( page_count > total_pages - first
+             || !os_commit( page_address( first ), page_count * page_size )
+             || !os_commit( heap_.page_map_ + first, page_count * sizeof( Span* ) ) )
+        {
+            return false;
+        }
+        auto* span = new_span( first, page_count );
+        if ( span == nullptr )
+        {
+            return false;
+        }
+        heap_.committed_pages_ += page_count;
+        free_span( span ); // Merges with a free span at the end of the heap
+        return true;
+    }
+
+    // First fit over the exact size lists, best fit over the large ones
+    static auto find_free( size_t page_count ) noexcept -> Span*
+    {
+        for ( auto n = page_count; n < listed_pages; ++n )
+        {
+            if ( heap_.free_lists_[n] != nullptr )
+            {
+                return heap_.free_lists_[n];
+            }
+        }
+        auto* best = static_cast<Span*>( nullptr );
+        for ( auto* span = heap_.free_lists_[listed_pages]; span != nullptr; span = span->next_ )
+        {
+            if ( span->page_count_ >= page_count && ( best == nullptr || span->page_count_ < best->page_count_ ) )
+            {
+                best = span;
+            }
+        }
+        return best;
+    }
+
+    static auto allocate_span( size_t page_count, size_t size_class ) noexcept -> Span*
+    {
+        auto lck = std::scoped_lock{ heap_.mutex_ };
+        auto* span = find_free( page_count );
+        if ( span == nullptr )
+        {
+            if ( !grow( page_count ) || ( span = find_free( page_count ) ) == nullptr )
+            {
+                return nullptr;
+            }
+        }
+        unlink( span );
+        if ( span->page_count_ > page_count )
+        {
+            auto* rest = new_span( span->first_page_ + page_count, span->page_count_ - page_count );
+            if ( rest == nullptr )
+            {
+                insert_free( span );
+                return nullptr;
+            }
+            span->page_count_ = page_count;
+            insert_free( rest );
+        }
+        assert( reinterpret_cast<std::uintptr_t>( page_address( span->first_page_ ) ) % page_size == 0 );
+        span->free_ = false;
+        span->size_class_ = size_class;
+        // Every page of a span in use maps to it, so any pointer into it can be freed
+        std::fill_n( heap_.page_map_ + span->first_page_, page_count, span );
+        ( size_class == 0 ? heap_.large_pages_ : heap_.small_pages_ ) += page_count;
+        return span;
+    }
+
+    //-------------------------------------------------------------------------
+    // Large objects
+
+    static auto allocate_large( size_t size, size_t align ) noexcept -> void*
+    {
+        if ( size > region_size )
+        {
+            return nullptr;
+        }
+        auto page_count = ( size + page_size - 1 ) >> page_shift;
+        if ( align > page_size )
+        {
+            page_count += ( align >> page_shift ) - 1;
+        }
+        auto* span = allocate_span( page_count, 0 );
+        if ( span == nullptr )
+        {
+            return nullptr;
+        }
+        const auto start = reinterpret_cast<std::uintptr_t>( page_address( span->first_page_ ) );
+        return reinterpret_cast<void*>( ( start + align - 1 ) & ~static_cast<std::uintptr_t>( align - 1 ) );
+    }
+
+    static auto deallocate_large( void* p ) noexcept -> void
+    {
+        auto lck = std::scoped_lock{ heap_.mutex_ };
+        auto* span = span_of( p );
+        heap_.large_pages_ -= span->page_count_;
+        free_span( span );
+    }
+
+    //-------------------------------------------------------------------------
+    // Central transfer cache
+
+    struct CentralList
+    {
+        std::mutex mutex_;
+        void* batches_{}; // Full batches
+        void* loose_{}; // Objects from new spans and partial batches
+        size_t loose_count_{};
+    };
+
+    struct FreeList
+    {
+        void* head_{};
+        size_t count_{};
+    };
+
+    // Unlinks up to n objects from the loose list of c
+    static auto take_loose( CentralList& c, size_t n ) noexcept -> FreeList
+    {
+        auto taken = FreeList{ c.loose_, 1 };
+        auto* last = c.loose_;
+        while ( taken.count_ < n && next( last ) != nullptr )
+        {
+            last = next( last );
+            ++taken.count_;
+        }
+        c.loose_ = std::exchange( next( last ), nullptr );
+        c.loose_count_ -= taken.count_;
+        return taken;
+    }
+
+    static auto central_fetch( size_t cls, size_t n ) noexcept -> FreeList
+    {
+        auto& c = central_[cls];
+        {
+            auto lck = std::scoped_lock{ c.mutex_ };
+            if ( n == batch_size( cls ) && c.batches_ != nullptr )
+            {
+                auto* batch = c.batches_;
+                c.batches_ = next_batch( batch );
+                return FreeList{ batch, n };
+            }
+            if ( c.loose_ == nullptr && c.batches_ != nullptr )
+            {
+                c.loose_ = c.batches_;
+                c.batches_ = next_batch( c.loose_ );
+                c.loose_count_ = batch_size( cls );
+            }
+            if ( c.loose_ != nullptr )
+            {
+                return take_loose( c, n );
+            }
+        }
+
+        // Carve a new span, without holding the central lock while the page heap works
+        auto* span = allocate_span( span_pages( cls ), cls );
+        if ( span == nullptr )
+        {
+            return FreeList{};
+        }
+        const auto size = class_size( cls );
+        const auto count = ( span->page_count_ << page_shift ) / size;
+        auto* first = page_address( span->first_page_ );
+        for ( auto i = size_t{ 0 }; i + 1 < count; ++i )
+        {
+            next( first + i * size ) = first + ( i + 1 ) * size;
+        }
+        auto lck = std::scoped_lock{ c.mutex_ };
+        next( first + ( count - 1 ) * size ) = c.loose_;
+        c.loose_ = first;
+        c.loose_count_ += count;
+        return take_loose( c, n );
+    }
+
+    // Takes a null terminated list of count objects
+    static auto central_release( size_t cls, void* head, size_t count ) noexcept -> void
+    {
+        auto& c = central_[cls];
+        auto* tail = head;
+        if ( count != batch_size( cls ) )
+        {
+            while ( next( tail ) != nullptr )
+            {
+                tail = next( tail );
+            }
+        }
+        auto lck = std::scoped_lock{ c.mutex_ };
+        if ( count == batch_size( cls ) )
+        {
+            next_batch( head ) = c.batches_;
+            c.batches_ = head;
+        }
+        else
+        {
+            next( tail ) = c.loose_;
+            c.loose_ = head;
+            c.loose_count_ += count;
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // Thread cache
+
+    static constexpr int thread_new = 0;
+    static constexpr int thread_active = 1;
+    static constexpr int thread_exited = 2; // The cache has been flushed, frees go straight to the central cache
+
+    // Gives the thread's cached objects back when it exits
+    struct ThreadCacheFlusher
+    {
+        ~ThreadCacheFlusher()
+        {
+            for ( auto cls = size_t{ 1 }; cls < class_count; ++cls )
+            {
+                auto& list = cache_[cls];
+                while ( list.head_ != nullptr )
+                {
+                    auto* head = list.head_;
+                    auto* last = head;
+                    auto count = size_t{ 1 };
+                    while ( count < batch_size( cls ) && next( last ) != nullptr )
+                    {
+                        last = next( last );
+                        ++count;
+                    }
+                    list.head_ = std::exchange( next( last ), nullptr );
+                    central_release( cls, head, count );
+                }
+                list.count_ = 0;
+            }
+            cache_state_ = thread_exited;
+        }
+    };
+
+    static auto release_batch( size_t cls, FreeList& list ) noexcept -> void
+    {
+        const auto n = batch_size( cls );
+        auto* last = list.head_;
+        for ( auto i = size_t{ 1 }; i < n; ++i )
+        {
+            last = next( last );
+        }
+        auto* batch = std::exchange( list.head_, std::exchange( next( last ), nullptr ) );
+        list.count_ -= n;
+        central_release( cls, batch, n );
+    }
+
+    static auto allocate_small( size_t cls ) noexcept -> void*
+    {
+        auto& list = cache_[cls];
+        if ( list.head_ == nullptr ) [[unlikely]]
+        {
+            if ( cache_state_ != thread_active )
+            {
+                if ( cache_state_ == thread_exited )
+                {
+                    return central_fetch( cls, 1 ).head_;
+                }
+                static thread_local auto flusher = ThreadCacheFlusher{};
+                cache_state_ = thread_active;
+            }
+            list = central_fetch( cls, batch_size( cls ) );
+            if ( list.head_ == nullptr )
+            {
+                return nullptr;
+            }
+        }
+        auto* p = list.head_;
+        list.head_ = next( p );
+        --list.count_;
+        return p;
+    }
+
+    static PageHeap heap_;
+    static CentralList central_[class_count];
+    static thread_local FreeList cache_[class_count];
+    static thread_local int cache_state_;
+};
+
+static_assert( ThreadCachingAllocator::class_size( ThreadCachingAllocator::class_count - 1 ) == ThreadCachingAllocator::max_small_size
+               && ThreadCachingAllocator::size_class( ThreadCachingAllocator::max_small_size ) == ThreadCachingAllocator::class_count - 1 );
+
+// All constant initialized, so the allocator works before any dynamic initialization has run
+inline constinit ThreadCachingAllocator::PageHeap ThreadCachingAllocator::heap_{};
+inline constinit ThreadCachingAllocator::CentralList ThreadCachingAllocator::central_[class_count]{};
+inline constinit thread_local ThreadCachingAllocator::FreeList ThreadCachingAllocator::cache_[class_count]{};
+inline constinit thread_local int ThreadCachingAllocator::cache_state_{ thread_new };
+
+//-------------------------------------------------------------------------
+
+#if defined( THREAD_CACHING_ALLOCATOR_REPLACE_NEW )
+
+namespace detail
+{
+    inline auto thread_caching_new( size_t size, size_t align ) -> void*
+    {
+        while ( true )
+        {
+            if ( auto* p = ThreadCachingAllocator::allocate( size, align ) )
+            {
+                return p;
+            }
+            auto handler = std::get_new_handler();
+            if ( handler == nullptr )
+            {
+                throw std::bad_alloc{};
+            }
+            handler();
+        }
+    }
+
+    inline auto thread_caching_new_nothrow( size_t size, size_t align ) noexcept -> void*
+    {
+        try
+        {
+            return thread_caching_new( size, align );
+        }
+        catch ( ... )
+        {
+            return nullptr;
+        }
+    }
+}
+
+auto operator new( size_t size ) -> void*
+{
+    return detail::thread_caching_new( size, __STDCPP_DEFAULT_NEW_ALIGNMENT__ );
+}
+auto operator new[]( size_t size ) -> void*
+{
+    return detail::thread_caching_new( size, __STDCPP_DEFAULT_NEW_ALIGNMENT__ );
+}
+auto operator new( size_t size, std::align_val_t al ) -> void*
+{
+    return detail::thread_caching_new( size, static_cast<size_t>( al ) );
+}
+auto operator new[]( size_t size, std::align_val_t al ) -> void*
+{
+    return detail::thread_caching_new( size, static_cast<size_t>( al ) );
+}
+auto operator new( size_t size, const std::nothrow_t& ) noexcept -> void*
+{
+    return detail::thread_caching_new_nothrow( size, __STDCPP_DEFAULT_NEW_ALIGNMENT__ );
+}
+auto operator new[]( size_t size, const std::nothrow_t& ) noexcept -> void*
+{
+    return detail::thread_caching_new_nothrow( size, __STDCPP_DEFAULT_NEW_ALIGNMENT__ );
+}
+auto operator new( size_t size, std::align_val_t al, const std::nothrow_t& ) noexcept -> void*
+{
+    return detail::thread_caching_new_nothrow( size, static_cast<size_t>( al ) );
+}
+auto operator new[]( size_t size, std::align_val_t al, const std::nothrow_t& ) noexcept -> void*
+{
+    return detail::thread_caching_new_nothrow( size, static_cast<size_t>( al ) );
+}
+
+// The page map knows the size and alignment of every pointer, so all deletes are the same
+auto operator delete( void* p ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete[]( void* p ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete( void* p, size_t ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete[]( void* p, size_t ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete( void* p, std::align_val_t ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete[]( void* p, std::align_val_t ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete( void* p, size_t, std::align_val_t ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete[]( void* p, size_t, std::align_val_t ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete( void* p, const std::nothrow_t& ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete[]( void* p, const std::nothrow_t& ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete( void* p, std::align_val_t, const std::nothrow_t& ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+auto operator delete[]( void* p, std::align_val_t, const std::nothrow_t& ) noexcept -> void
+{
+    ThreadCachingAllocator::deallocate( p );
+}
+
+#endif
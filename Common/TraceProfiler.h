@@ -0,0 +1,352 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A hierarchical instrumentation profiler.
+//
+// Every thread owns a single-producer/single-consumer ring buffer. The hot path only
+// writes one event (name pointer + timestamp) into its own buffer, no lock and no I/O.
+// A background flusher thread drains all buffers into a Chrome trace JSON file,
+// which can be opened in chrome://tracing or https://ui.perfetto.dev.
+//
+// Note: event names are stored as raw pointers, so they must outlive the session
+// (string literals and std::source_location::function_name() are fine).
+
+struct TraceEvent
+{
+    const char* name_{};
+    std::int64_t timestamp_ns_{};
+    char phase_{}; // 'B' (begin) or 'E' (end)
+};
+
+class TraceRingBuffer
+{
+public:
+    static constexpr size_t capacity = size_t{ 1 } << 14;
+    static_assert( ( capacity & ( capacity - 1 ) ) == 0, "capacity must be a power of two" );
+
+    explicit TraceRingBuffer( std::uint32_t tid ) noexcept : tid_{ tid }
+    {}
+
+    // Producer (owning thread) only.
+    // A begin event is only accepted if there is room left for the end events of every open scope,
+    // so a dropped event never leaves an unbalanced B/E pair in the trace.
+    auto push_begin( const char* name, std::int64_t ts ) noexcept -> bool
+    {
+        const auto head = head_.load( std::memory_order_relaxed );
+        const auto tail = tail_.load( std::memory_order_acquire );
+        if ( capacity - ( head - tail ) < open_scopes_ + 2 )
+        {
+            dropped_.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+        ++open_scopes_;
+        write( head, TraceEvent{ name, ts, 'B' } );
+        return true;
+    }
+    auto push_end( const char* name, std::int64_t ts ) noexcept -> void
+    {
+        // Always fits, since push_begin() reserved the slot
+        --open_scopes_;
+        write( head_.load( std::memory_order_relaxed ), TraceEvent{ name, ts, 'E' } );
+    }
+
+    // Consumer (flusher thread) only
+    template <class F>
+    auto drain( F&& f ) -> size_t
+    {
+        const auto tail = tail_.load( std::memory_order_relaxed );
+        const auto head = head_.load( std::memory_order_acquire );
+        for ( auto i = tail; i != head; ++i )
+        {
+            f( events_[i & ( capacity - 1 )] );
+        }
+        tail_.store( head, std::memory_order_release );
+        return head - tail;
+    }
+
+    auto tid() const noexcept
+    {
+        return tid_;
+    }
+    auto dropped() const noexcept
+    {
+        return dropped_.load( std::memory_order_relaxed );
+    }
+    auto retire() noexcept
+    {
+        retired_.store( true, std::memory_order_release );
+    }
+    auto is_retired() const noexcept
+    {
+        return retired_.load( std::memory_order_acquire );
+    }
+
+private:
+    auto write( size_t head, const TraceEvent& e ) noexcept -> void
+    {
+        events_[head & ( capacity - 1 )] = e;
+        head_.store( head + 1, std::memory_order_release );
+    }
+
+    // head_ and tail_ are written by different threads, keep them on separate cache lines
+    alignas( 64 ) std::atomic<size_t> head_{ 0 };
+    alignas( 64 ) std::atomic<size_t> tail_{ 0 };
+    alignas( 64 ) size_t open_scopes_{ 0 };
+    std::atomic<size_t> dropped_{ 0 };
+    std::atomic<bool> retired_{ false };
+    std::uint32_t tid_{};
+    std::array<TraceEvent, capacity> events_{};
+};
+
+class TraceProfiler
+{
+public:
+    using ClockType = std::chrono::steady_clock;
+
+    static auto instance() -> TraceProfiler&
+    {
+        static auto profiler = TraceProfiler{};
+        return profiler;
+    }
+
+    static auto is_active() noexcept -> bool
+    {
+        return instance().active_.load( std::memory_order_relaxed );
+    }
+
+    static auto begin_event( const char* name ) noexcept -> bool
+    {
+        return thread_buffer().push_begin( name, instance().now_ns() );
+    }
+    static auto end_event( const char* name ) noexcept -> void
+    {
+        thread_buffer().push_end( name, instance().now_ns() );
+    }
+
+    auto begin_session( const std::string& path,
+                        std::chrono::milliseconds flush_interval = std::chrono::milliseconds{ 10 } ) -> bool
+    {
+        auto lck = std::scoped_lock{ session_mutex_ };
+        if ( active_.load() )
+        {
+            return false;
+        }
+
+        out_.open( path, std::ios::out | std::ios::trunc );
+        if ( !out_ )
+        {
+            return false;
+        }
+
+        // Throw away events left behind by a previous session
+        drain_all( false );
+
+        epoch_.store( ClockType::now().time_since_epoch().count(), std::memory_order_relaxed );
+        first_event_ = true;
+        out_ << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+        stop_flusher_ = false;
+        flusher_ = std::thread{ [ this, flush_interval ]
+        {
+            auto lck = std::unique_lock{ flusher_mutex_ };
+            while ( !stop_flusher_ )
+            {
+                flusher_cv_.wait_for( lck, flush_interval );
+                drain_all( true );
+            }
+        } };
+
+        active_.store( true );
+        return true;
+    }
+
+    // Call after the worker threads have joined, open scopes on other threads are not waited for.
+    auto end_session() -> size_t
+    {
+        auto lck = std::scoped_lock{ session_mutex_ };
+        if ( !active_.exchange( false ) )
+        {
+            return 0;
+        }
+
+        {
+            auto flusher_lck = std::scoped_lock{ flusher_mutex_ };
+            stop_flusher_ = true;
+        }
+        flusher_cv_.notify_one();
+        flusher_.join();
+
+        drain_all( true );
+        out_ << "]}\n";
+        out_.close();
+
+        auto dropped = size_t{ 0 };
+        auto buffers_lck = std::scoped_lock{ buffers_mutex_ };
+        for ( const auto& b : buffers_ )
+        {
+            dropped += b->dropped();
+        }
+        return dropped;
+    }
+
+private:
+    TraceProfiler() = default;
+    ~TraceProfiler()
+    {
+        end_session();
+    }
+
+    // Registers the buffer on the first event of each thread,
+    // and retires it when the thread exits so the flusher can release it.
+    struct ThreadBufferHandle
+    {
+        ThreadBufferHandle() : buffer_{ instance().register_thread() }
+        {}
+        ~ThreadBufferHandle()
+        {
+            buffer_->retire();
+        }
+        std::shared_ptr<TraceRingBuffer> buffer_;
+    };
+
+    static auto thread_buffer() -> TraceRingBuffer&
+    {
+        static thread_local auto handle = ThreadBufferHandle{};
+        return *handle.buffer_;
+    }
+
+    auto register_thread() -> std::shared_ptr<TraceRingBuffer>
+    {
+        auto buffer = std::make_shared<TraceRingBuffer>( next_tid_.fetch_add( 1 ) );
+        auto lck = std::scoped_lock{ buffers_mutex_ };
+        buffers_.push_back( buffer );
+        return buffer;
+    }
+
+    auto now_ns() const noexcept -> std::int64_t
+    {
+        const auto epoch = ClockType::time_point{ ClockType::duration{ epoch_.load( std::memory_order_relaxed ) } };
+        return std::chrono::duration_cast<std::chrono::nanoseconds>( ClockType::now() - epoch ).count();
+    }
+
+    auto drain_all( bool write_events ) -> void
+    {
+        auto buffers = std::vector<std::shared_ptr<TraceRingBuffer>>{};
+        {
+            auto lck = std::scoped_lock{ buffers_mutex_ };
+            buffers = buffers_;
+        }
+
+        for ( const auto& b : buffers )
+        {
+            // Read the flag before draining, events pushed before retire() are then guaranteed to be visible
+            const auto retired = b->is_retired();
+            b->drain( [ & ] ( const TraceEvent& e )
+            {
+                if ( write_events )
+                {
+                    write_event( e, b->tid() );
+                }
+            } );
+            if ( retired )
+            {
+                auto lck = std::scoped_lock{ buffers_mutex_ };
+                std::erase( buffers_, b );
+            }
+        }
+        out_.flush();
+    }
+
+    auto write_event( const TraceEvent& e, std::uint32_t tid ) -> void
+    {
+        out_ << ( first_event_ ? "\n" : ",\n" );
+        first_event_ = false;
+
+        out_ << "{\"name\":\"";
+        for ( auto c = e.name_; *c != '\0'; ++c )
+        {
+            if ( *c == '"' || *c == '\\' )
+            {
+                out_ << '\\';
+            }
+            out_ << *c;
+        }
+        out_ << "\",\"ph\":\"" << e.phase_ << "\",\"pid\":1,\"tid\":" << tid
+             << ",\"ts\":" << e.timestamp_ns_ / 1000 << '.';
+        const auto frac = e.timestamp_ns_ % 1000;
+        out_ << ( frac < 100 ? "0" : "" ) << ( frac < 10 ? "0" : "" ) << frac << '}';
+    }
+
+    std::atomic<bool> active_{ false };
+    std::atomic<std::uint32_t> next_tid_{ 1 };
+    // Atomic, scopes still open on other threads read it while the next session starts
+    std::atomic<ClockType::rep> epoch_{ ClockType::now().time_since_epoch().count() };
+
+    std::mutex buffers_mutex_;
+    std::vector<std::shared_ptr<TraceRingBuffer>> buffers_;
+
+    std::mutex session_mutex_;
+    std::ofstream out_;
+    bool first_event_{ true };
+
+    std::thread flusher_;
+    std::mutex flusher_mutex_;
+    std::condition_variable flusher_cv_;
+    bool stop_flusher_{ false };
+};
+
+// RAII trace scope, records nothing when no session is active
+class TraceScope
+{
+public:
+    explicit TraceScope( const char* name ) noexcept
+        : name_{ name }, recorded_{ TraceProfiler::is_active() && TraceProfiler::begin_event( name ) }
+    {}
+    TraceScope( const TraceScope& ) = delete;
+    TraceScope& operator=( const TraceScope& ) = delete;
+    ~TraceScope()
+    {
+        if ( recorded_ )
+        {
+            TraceProfiler::end_event( name_ );
+        }
+    }
+private:
+    const char* name_{};
+    bool recorded_{};
+};
+
+// RAII trace session, writes the trace file when destroyed
+class TraceSession
+{
+public:
+    explicit TraceSession( const std::string& path )
+        : started_{ TraceProfiler::instance().begin_session( path ) }
+    {}
+    TraceSession( const TraceSession& ) = delete;
+    TraceSession& operator=( const TraceSession& ) = delete;
+    ~TraceSession()
+    {
+        if ( started_ )
+        {
+            TraceProfiler::instance().end_session();
+        }
+    }
+private:
+    bool started_{};
+};
+
+#define TRACE_CONCAT_IMPL( a, b ) a##b
+#define TRACE_CONCAT( a, b ) TRACE_CONCAT_IMPL( a, b )
+#define TRACE_SCOPE( name ) TraceScope TRACE_CONCAT( __trace_scope_, __LINE__ ){ name }
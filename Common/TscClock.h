@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HP_HAS_TSC 1
+#else
+#define HP_HAS_TSC 0
+#endif
+
+// A cycle-accurate clock based on the time stamp counter (TSC).
+//
+// steady_clock::now() costs a few tens of nanoseconds and ScopedTimer truncates to microseconds,
+// so short hot paths like LockFreeQueue::push() or SimpleMutex::lock() always read 0 us.
+// rdtsc costs a handful of cycles.
+//
+// On modern x86 CPUs the TSC is invariant: it ticks at a constant rate regardless of frequency
+// scaling and C-states, so ticks can be converted to nanoseconds. The rate is calibrated once
+// against steady_clock at startup. Without an invariant TSC (or on other architectures) the
+// clock falls back to steady_clock, and ticks are nanoseconds.
+//
+// rdtsc is not serializing, it may execute before the preceding instructions have finished.
+// start() uses lfence + rdtsc, stop() uses rdtscp + lfence, so the measured region is fenced on both sides.
+
+class TscClock
+{
+public:
+    static auto has_invariant_tsc() noexcept -> bool
+    {
+#if HP_HAS_TSC
+        // CPUID.80000007H:EDX[8]
+#if defined(_MSC_VER)
+        int regs[4]{};
+        __cpuid( regs, 0x80000000 );
+        if ( static_cast<unsigned>( regs[0] ) < 0x80000007u )
+        {
+            return false;
+        }
+        __cpuid( regs, 0x80000007 );
+        return ( regs[3] & ( 1 << 8 ) ) != 0;
+#else
+        unsigned eax{}, ebx{}, ecx{}, edx{};
+        if ( __get_cpuid_max( 0x80000000, nullptr ) < 0x80000007u )
+        {
+            return false;
+        }
+        __get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx );
+        return ( edx & ( 1u << 8 ) ) != 0;
+#endif
+#else
+        return false;
+#endif
+    }
+
+    // Raw ticks, no ordering guarantee
+    static auto now() noexcept -> std::uint64_t
+    {
+#if HP_HAS_TSC
+        if ( calibration().use_tsc_ )
+        {
+            return __rdtsc();
+        }
+#endif
+        return steady_ticks();
+    }
+
+    // Ticks at the start of a measured region, later instructions don't start before the read
+    static auto start() noexcept -> std::uint64_t
+    {
+#if HP_HAS_TSC
+        if ( calibration().use_tsc_ )
+        {
+            _mm_lfence();
+            const auto t = __rdtsc();
+            _mm_lfence();
+            return t;
+        }
+#endif
+        return steady_ticks();
+    }
+
+    // Ticks at the end of a measured region, waits for the preceding instructions
+    static auto stop() noexcept -> std::uint64_t
+    {
+#if HP_HAS_TSC
+        if ( calibration().use_tsc_ )
+        {
+            auto aux = 0u;
+            const auto t = __rdtscp( &aux );
+            _mm_lfence();
+            return t;
+        }
+#endif
+        return steady_ticks();
+    }
+
+    static auto is_tsc() noexcept -> bool
+    {
+        return calibration().use_tsc_;
+    }
+    static auto ticks_per_ns() noexcept -> double
+    {
+        return calibration().ticks_per_ns_;
+    }
+    static auto to_ns( std::uint64_t ticks ) noexcept -> double
+    {
+        return static_cast<double>( ticks ) / calibration().ticks_per_ns_;
+    }
+
+    // Warm up the calibration explicitly, otherwise it happens on the first measurement
+    static auto calibrate() noexcept -> void
+    {
+        ( void )calibration();
+    }
+
+private:
+    struct Calibration
+    {
+        bool use_tsc_{ false };
+        double ticks_per_ns_{ 1.0 };
+    };
+
+    static auto steady_ticks() noexcept -> std::uint64_t
+    {
+        return static_cast<std::uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count() );
+    }
+
+    static auto calibration() noexcept -> const Calibration&
+    {
+        static const auto c = []
+        {
+            auto result = Calibration{};
+#if HP_HAS_TSC
+            if ( !has_invariant_tsc() )
+            {
+                return result;
+            }
+            // Median of a few short windows, a preempted window only skews one of them
+            using ClockType = std::chrono::steady_clock;
+            double rates[3]{};
+            for ( auto& rate : rates )
+            {
+                const auto t0 = ClockType::now();
+                const auto c0 = __rdtsc();
+                std::this_thread::sleep_for( std::chrono::milliseconds{ 10 } );
+                const auto t1 = ClockType::now();
+                const auto c1 = __rdtsc();
+                rate = static_cast<double>( c1 - c0 ) / std::chrono::duration<double, std::nano>( t1 - t0 ).count();
+            }
+            std::sort( std::begin( rates ), std::end( rates ) );
+            const auto best = rates[1];
+            result.use_tsc_ = best > 0.0;
+            result.ticks_per_ns_ = best > 0.0 ? best : 1.0;
+#endif
+            return result;
+        }();
+        return c;
+    }
+};
+
+// Per call site statistics, updated lock-free from any thread.
+// Call sites are owned by a registry, so they can still be reported at exit.
+class TscCallSite
+{
+public:
+    explicit TscCallSite( const char* name ) noexcept : name_{ name }
+    {}
+    TscCallSite( const TscCallSite& ) = delete;
+    TscCallSite& operator=( const TscCallSite& ) = delete;
+
+    static auto get( const char* name ) -> TscCallSite&
+    {
+        return registry().add( name );
+    }
+
+    auto record( std::uint64_t ticks ) noexcept -> void
+    {
+        calls_.fetch_add( 1, std::memory_order_relaxed );
+        total_ticks_.fetch_add( ticks, std::memory_order_relaxed );
+        auto min = min_ticks_.load( std::memory_order_relaxed );
+        while ( ticks < min && !min_ticks_.compare_exchange_weak( min, ticks, std::memory_order_relaxed ) )
+        {}
+        auto max = max_ticks_.load( std::memory_order_relaxed );
+        while ( ticks > max && !max_ticks_.compare_exchange_weak( max, ticks, std::memory_order_relaxed ) )
+        {}
+    }
+
+    auto print( std::ostream& os ) const -> void
+    {
+        const auto calls = calls_.load( std::memory_order_relaxed );
+        if ( calls == 0 )
+        {
+            return;
+        }
+        const auto mean = static_cast<double>( total_ticks_.load( std::memory_order_relaxed ) ) / static_cast<double>( calls );
+        char buf[160];
+        std::snprintf( buf, sizeof( buf ), "%10.1f ns/call  min %.1f ns  max %.1f ns  ",
+                       mean / TscClock::ticks_per_ns(),
+                       TscClock::to_ns( min_ticks_.load( std::memory_order_relaxed ) ),
+                       TscClock::to_ns( max_ticks_.load( std::memory_order_relaxed ) ) );
+        os << buf;
+        if ( TscClock::is_tsc() )
+        {
+            std::snprintf( buf, sizeof( buf ), "%.1f cycles/call  ", mean );
+            os << buf;
+        }
+        os << calls << " calls  " << name_ << '\n';
+    }
+
+    // Prints every call site that has been hit, also done automatically at exit
+    static auto print_all( std::ostream& os ) -> void
+    {
+        registry().print( os );
+    }
+
+private:
+    class Registry
+    {
+    public:
+        ~Registry()
+        {
+            print( std::cout );
+        }
+        auto add( const char* name ) -> TscCallSite&
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            return sites_.emplace_back( name );
+        }
+        auto print( std::ostream& os ) -> void
+        {
+            auto lck = std::scoped_lock{ mutex_ };
+            if ( sites_.empty() )
+            {
+                return;
+            }
+            os << "\n-- per call site timings (" << ( TscClock::is_tsc() ? "invariant TSC" : "steady_clock" ) << ") --\n";
+            for ( const auto& site : sites_ )
+            {
+                site.print( os );
+            }
+        }
+    private:
+        std::mutex mutex_;
+        std::deque<TscCallSite> sites_; // Stable addresses
+    };
+
+    static auto registry() -> Registry&
+    {
+        static auto r = Registry{};
+        return r;
+    }
+
+    const char* name_{};
+    std::atomic<std::uint64_t> calls_{ 0 };
+    std::atomic<std::uint64_t> total_ticks_{ 0 };
+    std::atomic<std::uint64_t> min_ticks_{ UINT64_MAX };
+    std::atomic<std::uint64_t> max_ticks_{ 0 };
+};
+
+class ScopedTscTimer
+{
+public:
+    explicit ScopedTscTimer( TscCallSite& site ) noexcept : site_{ site }, start_{ TscClock::start() }
+    {}
+    ScopedTscTimer( const ScopedTscTimer& ) = delete;
+    ScopedTscTimer& operator=( const ScopedTscTimer& ) = delete;
+    ~ScopedTscTimer()
+    {
+        site_.record( TscClock::stop() - start_ );
+    }
+private:
+    TscCallSite& site_;
+    const std::uint64_t start_{};
+};